@@ -16,7 +16,6 @@ LOCAL_SRC_FILES := \
     VideoTex.cpp \
     StreamHandler.cpp \
     WindowSurface.cpp \
-    FormatConvert.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
     libcutils \
@@ -36,6 +35,7 @@ LOCAL_SHARED_LIBRARIES := \
 LOCAL_STATIC_LIBRARIES := \
     libmath \
     libjsoncpp \
+    libevssupport \
 
 LOCAL_STRIP_MODULE := keep_symbols
 
@@ -51,6 +51,35 @@ LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
 include $(BUILD_EXECUTABLE)
 
 
+##################################
+# Per-frame cost of setting up the display's render targets
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    RenderTarget_benchmark.cpp \
+    RenderBase.cpp \
+    glError.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    liblog \
+    libutils \
+    libui \
+    libhidlbase \
+    libEGL \
+    libGLESv2 \
+    android.hardware.automotive.evs@1.0 \
+
+LOCAL_MODULE := evs_app_render_target_benchmark
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -DLOG_TAG=\"EvsAppBenchmark\"
+LOCAL_CFLAGS += -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_NATIVE_BENCHMARK)
+
+
 include $(CLEAR_VARS)
 LOCAL_MODULE := config.json
 LOCAL_MODULE_CLASS := ETC
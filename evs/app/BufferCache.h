@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BUFFERCACHE_H
+#define BUFFERCACHE_H
+
+#include <functional>
+#include <map>
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+
+
+/*
+ * Keeps whatever GL objects we've built around the buffers someone keeps sending us (the camera's
+ * frames, the display's targets), so that seeing a buffer again costs nothing.
+ *
+ * Entries are found by bufferId, as the handle is recreated, with fresh fds, for every
+ * transaction.  Nothing we're sent tells us reliably when a producer has reused an ID for a new
+ * buffer (on older kernels every dma-buf fd shares the one inode, so even the file behind the
+ * handle doesn't), so our owner must clear() us whenever the producer may have reissued its
+ * buffers: when its stream is restarted, or its buffer count changed.  A buffer turning up
+ * under a known ID with a different size or format is caught here all the same.
+ */
+template <typename T>
+class BufferCache {
+public:
+    explicit BufferCache(std::function<void(T*)> release) : mRelease(release) {};
+
+    // Returns what we built for this buffer before, or null if it's new to us.  Anything we had
+    // for an older buffer under the same ID is released.  Each call counts as a use.
+    T* find(const BufferDesc& buffer) {
+        mUseCount++;
+
+        auto it = mEntries.find(buffer.bufferId);
+        if (it == mEntries.end()) {
+            return nullptr;
+        }
+
+        if (!(it->second.identity == Identity(buffer))) {
+            mRelease(&it->second.value);
+            mEntries.erase(it);
+            return nullptr;
+        }
+
+        it->second.lastUsed = mUseCount;
+        return &it->second.value;
+    }
+
+    // Keeps what we've built for a buffer that find() didn't know
+    T* add(const BufferDesc& buffer, const T& value) {
+        auto it = mEntries.find(buffer.bufferId);
+        if (it != mEntries.end()) {
+            mRelease(&it->second.value);
+            mEntries.erase(it);
+        }
+
+        Entry& entry = mEntries[buffer.bufferId];
+        entry.identity = Identity(buffer);
+        entry.value = value;
+        entry.lastUsed = mUseCount;
+        return &entry.value;
+    }
+
+    // Lets go of what we've kept for buffers not seen in the last maxUnused uses
+    void releaseUnused(unsigned maxUnused) {
+        for (auto it = mEntries.begin(); it != mEntries.end(); ) {
+            if (mUseCount - it->second.lastUsed > maxUnused) {
+                mRelease(&it->second.value);
+                it = mEntries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Lets go of the buffer we've gone longest without seeing
+    void releaseOldest() {
+        auto oldest = mEntries.begin();
+        for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+            if (mUseCount - it->second.lastUsed > mUseCount - oldest->second.lastUsed) {
+                oldest = it;
+            }
+        }
+        if (oldest != mEntries.end()) {
+            mRelease(&oldest->second.value);
+            mEntries.erase(oldest);
+        }
+    }
+
+    void clear() {
+        for (auto&& entry : mEntries) {
+            mRelease(&entry.second.value);
+        }
+        mEntries.clear();
+    }
+
+    size_t size() const     { return mEntries.size(); };
+
+private:
+    // What a buffer sent under a known ID must match to be taken for the one we've seen
+    struct Identity {
+        Identity() = default;
+        explicit Identity(const BufferDesc& buffer) :
+                width(buffer.width), height(buffer.height), stride(buffer.stride),
+                format(buffer.format), usage(buffer.usage) {};
+
+        bool operator==(const Identity& other) const {
+            return width  == other.width  && height == other.height &&
+                   stride == other.stride && format == other.format &&
+                   usage  == other.usage;
+        };
+
+        uint32_t    width = 0;
+        uint32_t    height = 0;
+        uint32_t    stride = 0;
+        uint32_t    format = 0;
+        uint32_t    usage = 0;
+    };
+
+    struct Entry {
+        Identity    identity;
+        T           value;
+        unsigned    lastUsed = 0;
+    };
+
+    std::function<void(T*)>     mRelease;
+    std::map<uint32_t, Entry>   mEntries;   // By bufferId
+    unsigned                    mUseCount = 0;
+};
+
+
+#endif // BUFFERCACHE_H
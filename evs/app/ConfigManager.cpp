@@ -15,6 +15,7 @@
  */
 #include "ConfigManager.h"
 
+#include "ColorConvert.h"
 #include "json/json.h"
 
 #include <fstream>
@@ -31,6 +32,31 @@ static float normalizeToPlusMinus180degrees(float theta) {
 }
 
 
+using namespace ::android::automotive::evs::support;
+
+
+// Map the optional color matrix name from a camera record onto a ColorMatrix
+static int32_t parseColorMatrix(const std::string& name) {
+    if (name == "bt601") return COLOR_MATRIX_BT601;
+    if (name == "bt709") return COLOR_MATRIX_BT709;
+    if (!name.empty()) {
+        printf("Ignoring unrecognized colorMatrix %s\n", name.c_str());
+    }
+    return -1;
+}
+
+
+// Map the optional color range name from a camera record onto a ColorRange
+static int32_t parseColorRange(const std::string& name) {
+    if (name == "limited") return COLOR_RANGE_LIMITED;
+    if (name == "full")    return COLOR_RANGE_FULL;
+    if (!name.empty()) {
+        printf("Ignoring unrecognized colorRange %s\n", name.c_str());
+    }
+    return -1;
+}
+
+
 static bool readChildNodeAsFloat(const char* groupName,
                                  const Json::Value& parentNode,
                                  const char* childName,
@@ -178,6 +204,8 @@ bool ConfigManager::initialize(const char* configFileName)
             info.vfov        = vfov  * kDegreesToRadians;
             info.cameraId    = cameraId;
             info.function    = function;
+            info.colorMatrix = parseColorMatrix(node.get("colorMatrix", "").asString());
+            info.colorRange  = parseColorRange(node.get("colorRange", "").asString());
 
             mCameras.push_back(info);
         }
@@ -18,6 +18,7 @@
 
 #include <vector>
 #include <string>
+#include <stdint.h>
 
 
 class ConfigManager {
@@ -30,6 +31,8 @@ public:
         float pitch = 0;    // positive upward (ie: right hand rule about local x axis)
         float hfov  = 0;    // radians
         float vfov  = 0;    // radians
+        int32_t colorMatrix = -1;   // ColorMatrix, or -1 to accept the camera's default
+        int32_t colorRange  = -1;   // ColorRange, or -1 to accept the camera's default
     };
 
     bool initialize(const char* configFileName);
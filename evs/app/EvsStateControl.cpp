@@ -16,6 +16,7 @@
 #include "EvsStateControl.h"
 #include "RenderDirectView.h"
 #include "RenderTopView.h"
+#include "VideoTex.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -23,6 +24,15 @@
 #include <log/log.h>
 
 
+// If no new frames come (as when a camera in our configuration doesn't exist) we still redraw this
+// often, so the rest of the display keeps up with state changes
+static const std::chrono::milliseconds kMaxFrameInterval(100);
+
+// How long renderers and camera streams we've stopped using are kept around, so that going from
+// reverse to park and back (say) doesn't have to set them up again
+static const std::chrono::seconds kIdleTimeout(10);
+
+
 // TODO:  Seems like it'd be nice if the Vehicle HAL provided such helpers (but how & where?)
 inline constexpr VehiclePropertyType getPropType(VehicleProperty prop) {
     return static_cast<VehiclePropertyType>(
@@ -115,7 +125,20 @@ EvsStateControl::EvsStateControl(android::sp <IVehicle>       pVnet,
 }
 
 
+void EvsStateControl::setMaxFrameRate(unsigned framesPerSecond) {
+    if (framesPerSecond == 0) {
+        mMinFrameInterval = std::chrono::steady_clock::duration::zero();
+    } else {
+        mMinFrameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::seconds(1)) / framesPerSecond;
+    }
+}
+
+
 bool EvsStateControl::startUpdateLoop() {
+    // Our cameras' streams tell us when there's something new to draw
+    StreamHandler::setFrameListener([this](){ notifyNewFrame(); });
+
     // Create the thread and report success if it gets started
     mRenderThread = std::thread([this](){ updateLoop(); });
     return mRenderThread.joinable();
@@ -137,6 +160,9 @@ void EvsStateControl::updateLoop() {
     ALOGD("Starting EvsStateControl update loop");
 
     bool run = true;
+    bool checkVehicle = true;   // We start off knowing nothing of the vehicle state
+    bool stateChanged = true;
+    std::chrono::steady_clock::time_point lastDrawTime;
     while (run) {
         // Process incoming commands
         {
@@ -148,7 +174,12 @@ void EvsStateControl::updateLoop() {
                     run = false;
                     break;
                 case Op::CHECK_VEHICLE_STATE:
-                    // Just running selectStateForCurrentConditions below will take care of this
+                    checkVehicle = true;
+                    break;
+                case Op::PROPERTY_EVENT:
+                    applyPropertyEvent(static_cast<int32_t>(cmd.arg1),
+                                       static_cast<int32_t>(cmd.arg2));
+                    stateChanged = true;
                     break;
                 case Op::TOUCH_EVENT:
                     // TODO:  Implement this given the x/y location of the touch event
@@ -159,14 +190,36 @@ void EvsStateControl::updateLoop() {
             }
         }
 
-        // Review vehicle state and choose an appropriate renderer
-        if (!selectStateForCurrentConditions()) {
-            ALOGE("selectStateForCurrentConditions failed so we're going to die");
-            break;
+        // Only block on the Vehicle HAL when we're asked to, rather than on every frame
+        if (checkVehicle && mVehicle != nullptr) {
+            if (!readVehicleState()) {
+                ALOGE("GEAR_SELECTION not available from vehicle.  Exiting.");
+                break;
+            }
+            stateChanged = true;
         }
+        checkVehicle = false;
+
+        // Review vehicle state and choose an appropriate renderer.  Without a vehicle our
+        // pretend state changes with time, so is checked every time round.
+        if (stateChanged || mVehicle == nullptr) {
+            if (!selectStateForCurrentConditions()) {
+                ALOGE("selectStateForCurrentConditions failed so we're going to die");
+                break;
+            }
+            stateChanged = false;
+        }
+        releaseIdleRenderers();
 
         // If we have an active renderer, give it a chance to draw
         if (mCurrentRenderer) {
+            // Rather than redraw the same images over and over, wait for a camera to give us a
+            // new one.  Commands arriving in the meantime are seen to first.
+            if (!waitForNewFrame(lastDrawTime)) {
+                continue;
+            }
+            lastDrawTime = std::chrono::steady_clock::now();
+
             // Get the output buffer we'll use to display the imagery
             BufferDesc tgtBuffer = {};
             mDisplay->getTargetBuffer([&tgtBuffer](const BufferDesc& buff) {
@@ -189,7 +242,7 @@ void EvsStateControl::updateLoop() {
         } else {
             // No active renderer, so sleep until somebody wakes us with another command
             std::unique_lock<std::mutex> lock(mLock);
-            mWakeSignal.wait(lock);
+            mWakeSignal.wait(lock, [this](){ return !mCommandQueue.empty(); });
         }
     }
 
@@ -202,22 +255,70 @@ void EvsStateControl::updateLoop() {
 }
 
 
-bool EvsStateControl::selectStateForCurrentConditions() {
-    static int32_t sDummyGear   = int32_t(VehicleGear::GEAR_REVERSE);
-    static int32_t sDummySignal = int32_t(VehicleTurnSignal::NONE);
+// Sleeps until there's a new frame to draw, or it's been kMaxFrameInterval since we last drew.
+// Returns false without waiting for that if there are commands to process.
+bool EvsStateControl::waitForNewFrame(std::chrono::steady_clock::time_point lastDrawTime) {
+    std::unique_lock<std::mutex> lock(mLock);
 
-    if (mVehicle != nullptr) {
-        // Query the car state
-        if (invokeGet(&mGearValue) != StatusCode::OK) {
-            ALOGE("GEAR_SELECTION not available from vehicle.  Exiting.");
-            return false;
-        }
-        if ((mTurnSignalValue.prop == 0) || (invokeGet(&mTurnSignalValue) != StatusCode::OK)) {
-            // Silently treat missing turn signal state as no turn signal active
-            mTurnSignalValue.value.int32Values.setToExternal(&sDummySignal, 1);
-            mTurnSignalValue.prop = 0;
-        }
+    // Hold back if we're drawing more often than we've been told to
+    if (mMinFrameInterval.count() > 0) {
+        mWakeSignal.wait_until(lock, lastDrawTime + mMinFrameInterval,
+                               [this](){ return !mCommandQueue.empty(); });
+    }
+
+    mWakeSignal.wait_until(lock, lastDrawTime + kMaxFrameInterval,
+                           [this](){ return mNewFrame || !mCommandQueue.empty(); });
+    if (!mCommandQueue.empty()) {
+        return false;
+    }
+
+    mNewFrame = false;
+    return true;
+}
+
+
+// Called on the camera stream delivery threads
+void EvsStateControl::notifyNewFrame() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mNewFrame = true;
+    }
+    mWakeSignal.notify_all();
+}
+
+
+// Queries the Vehicle HAL for the state we care about, which blocks until it answers
+bool EvsStateControl::readVehicleState() {
+    if (invokeGet(&mGearValue) != StatusCode::OK) {
+        return false;
+    }
+    mGear = mGearValue.value.int32Values[0];
+
+    if ((mTurnSignalValue.prop == 0) || (invokeGet(&mTurnSignalValue) != StatusCode::OK)) {
+        // Silently treat missing turn signal state as no turn signal active (and stop asking)
+        mTurnSignalValue.prop = 0;
+        mTurnSignal = int32_t(VehicleTurnSignal::NONE);
     } else {
+        mTurnSignal = mTurnSignalValue.value.int32Values[0];
+    }
+
+    return true;
+}
+
+
+void EvsStateControl::applyPropertyEvent(int32_t propId, int32_t value) {
+    if (propId == int32_t(VehicleProperty::GEAR_SELECTION)) {
+        mGear = value;
+    } else if (propId == int32_t(VehicleProperty::TURN_SIGNAL_STATE)) {
+        mTurnSignal = value;
+    } else {
+        ALOGW("Ignoring event for unexpected property 0x%X", propId);
+    }
+}
+
+
+bool EvsStateControl::selectStateForCurrentConditions() {
+    if (mVehicle == nullptr) {
         // While testing without a vehicle, behave as if we're in reverse for the first 20 seconds
         static const int kShowTime = 20;    // seconds
 
@@ -226,24 +327,23 @@ bool EvsStateControl::selectStateForCurrentConditions() {
         std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
         if (std::chrono::duration_cast<std::chrono::seconds>(now - start).count() > kShowTime) {
             // Switch to drive (which should turn off the reverse camera)
-            sDummyGear = int32_t(VehicleGear::GEAR_DRIVE);
+            mGear = int32_t(VehicleGear::GEAR_DRIVE);
+        } else {
+            mGear = int32_t(VehicleGear::GEAR_REVERSE);
         }
-
-        // Build the dummy vehicle state values (treating single values as 1 element vectors)
-        mGearValue.value.int32Values.setToExternal(&sDummyGear, 1);
-        mTurnSignalValue.value.int32Values.setToExternal(&sDummySignal, 1);
+        mTurnSignal = int32_t(VehicleTurnSignal::NONE);
     }
 
     // Choose our desired EVS state based on the current car state
     // TODO:  Update this logic, and consider user input when choosing if a view should be presented
     State desiredState = OFF;
-    if (mGearValue.value.int32Values[0] == int32_t(VehicleGear::GEAR_REVERSE)) {
+    if (mGear == int32_t(VehicleGear::GEAR_REVERSE)) {
         desiredState = REVERSE;
-    } else if (mTurnSignalValue.value.int32Values[0] == int32_t(VehicleTurnSignal::RIGHT)) {
+    } else if (mTurnSignal == int32_t(VehicleTurnSignal::RIGHT)) {
         desiredState = RIGHT;
-    } else if (mTurnSignalValue.value.int32Values[0] == int32_t(VehicleTurnSignal::LEFT)) {
+    } else if (mTurnSignal == int32_t(VehicleTurnSignal::LEFT)) {
         desiredState = LEFT;
-    } else if (mGearValue.value.int32Values[0] == int32_t(VehicleGear::GEAR_PARK)) {
+    } else if (mGear == int32_t(VehicleGear::GEAR_PARK)) {
         desiredState = PARKING;
     }
 
@@ -282,14 +382,34 @@ bool EvsStateControl::configureEvsPipeline(State desiredState) {
     ALOGD("  Desired state %d has %zu cameras", desiredState,
           mCameraList[desiredState].size());
 
-    // Since we're changing states, shut down the current renderer
+    // Since we're changing states, shut down the current renderer.  It's kept for a while in
+    // case we come back to it.
     if (mCurrentRenderer != nullptr) {
         mCurrentRenderer->deactivate();
-        mCurrentRenderer = nullptr; // It's a smart pointer, so destructs on assignment to null
+        mIdleRenderers[mCurrentRendererKey] = { std::move(mCurrentRenderer),
+                                                std::chrono::steady_clock::now() };
+        mCurrentRenderer = nullptr;
+        mCurrentRendererKey.clear();
+    }
+
+    // The display may hand out new buffers once we've changed its state, so whichever renderer
+    // draws next sets up its targets afresh
+    RenderBase::releaseRenderTargets();
+
+    // Renderers are told apart by the kind of view and the cameras in it
+    const bool topView = (mCameraList[desiredState].size() > 1 || desiredState == PARKING);
+    std::string key = topView ? "top" : "direct";
+    for (auto&& cam : mCameraList[desiredState]) {
+        key += ":" + cam.cameraId;
     }
 
-    // Do we need a new direct view renderer?
-    if (mCameraList[desiredState].size() > 1 || desiredState == PARKING) {
+    // Pick up where we left off if we've shown this view recently
+    auto idle = mIdleRenderers.find(key);
+    if (idle != mIdleRenderers.end()) {
+        mCurrentRenderer = std::move(idle->second.renderer);
+        mIdleRenderers.erase(idle);
+    } else if (topView) {
+        // Do we need a new top view renderer?
         // TODO:  DO we want other kinds of compound view or else sequentially selected views?
         mCurrentRenderer = std::make_unique<RenderTopView>(mEvs,
                                                            mCameraList[desiredState],
@@ -307,6 +427,9 @@ bool EvsStateControl::configureEvsPipeline(State desiredState) {
             return false;
         }
     }
+    if (mCurrentRenderer != nullptr) {
+        mCurrentRendererKey = key;
+    }
 
     // Now set the display state based on whether we have a video feed to show
     if (mCurrentRenderer == nullptr) {
@@ -335,3 +458,19 @@ bool EvsStateControl::configureEvsPipeline(State desiredState) {
 
     return true;
 }
+
+
+// Drops the renderers, and closes the camera streams, we've had no use for in a while
+void EvsStateControl::releaseIdleRenderers() {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = mIdleRenderers.begin(); it != mIdleRenderers.end(); ) {
+        if (now - it->second.idleSince >= kIdleTimeout) {
+            ALOGD("Dropping idle renderer %s", it->first.c_str());
+            it = mIdleRenderers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    releaseIdleVideoTextures(kIdleTimeout);
+}
@@ -26,6 +26,9 @@
 #include <android/hardware/automotive/evs/1.0/IEvsDisplay.h>
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 
+#include <chrono>
+#include <map>
+#include <string>
 #include <thread>
 
 
@@ -61,7 +64,8 @@ public:
 
     enum class Op {
         EXIT,
-        CHECK_VEHICLE_STATE,
+        CHECK_VEHICLE_STATE,    // Ask the Vehicle HAL afresh, in case we missed an event
+        PROPERTY_EVENT,         // arg1 is a property ID and arg2 its new int32 value
         TOUCH_EVENT,
     };
 
@@ -71,6 +75,10 @@ public:
         uint32_t    arg2;
     };
 
+    // Caps how often we draw.  Zero (the default) lets the cameras set the pace.  Call before
+    // startUpdateLoop.
+    void setMaxFrameRate(unsigned framesPerSecond);
+
     // This spawns a new thread that is expected to run continuously
     bool startUpdateLoop();
 
@@ -79,22 +87,40 @@ public:
 
 private:
     void updateLoop();
+    bool waitForNewFrame(std::chrono::steady_clock::time_point lastDrawTime);
+    void notifyNewFrame();
     StatusCode invokeGet(VehiclePropValue *pRequestedPropValue);
+    bool readVehicleState();
+    void applyPropertyEvent(int32_t propId, int32_t value);
     bool selectStateForCurrentConditions();
     bool configureEvsPipeline(State desiredState);  // Only call from one thread!
+    void releaseIdleRenderers();
 
     sp<IVehicle>                mVehicle;
     sp<IEvsEnumerator>          mEvs;
     sp<IEvsDisplay>             mDisplay;
     const ConfigManager&        mConfig;
 
-    VehiclePropValue            mGearValue;
+    VehiclePropValue            mGearValue;         // Only used to query the Vehicle HAL
     VehiclePropValue            mTurnSignalValue;
 
+    // The vehicle state as we last heard it, from a query or a property event
+    int32_t                     mGear       = int32_t(VehicleGear::GEAR_PARK);
+    int32_t                     mTurnSignal = int32_t(VehicleTurnSignal::NONE);
+
     State                       mCurrentState = OFF;
 
     std::vector<ConfigManager::CameraInfo>  mCameraList[NUM_STATES];
     std::unique_ptr<RenderBase> mCurrentRenderer;
+    std::string                 mCurrentRendererKey;
+
+    // Renderers we've moved away from, by the kind of view and cameras they show, kept for a
+    // while in case we come back to them
+    struct IdleRenderer {
+        std::unique_ptr<RenderBase>             renderer;
+        std::chrono::steady_clock::time_point   idleSince;
+    };
+    std::map<std::string, IdleRenderer>     mIdleRenderers;
 
     std::thread                 mRenderThread;  // The thread that runs the main rendering loop
 
@@ -102,6 +128,9 @@ private:
     std::mutex                  mLock;
     std::condition_variable     mWakeSignal;
     std::queue<Command>         mCommandQueue;
+    bool                        mNewFrame = false;  // A camera has delivered since we last drew
+
+    std::chrono::steady_clock::duration mMinFrameInterval{0};
 };
 
 
@@ -19,20 +19,27 @@
 
 #include "EvsStateControl.h"
 
+#include <map>
+
 /*
- * This class listens for asynchronous updates from the Vehicle HAL.  While the EVS
- * applications is active, it can poll the vehicle state directly.  However, when it goes to
- * sleep, we need these notifications to bring it active again.
+ * This class listens for asynchronous updates from the Vehicle HAL.  The values reported are
+ * passed on to the state controller as commands, so it never has to block on the Vehicle HAL
+ * while it's rendering.  Every so often it's also asked to check the vehicle state for itself,
+ * in case we missed an event.
  */
 class EvsVehicleListener : public IVehicleCallback {
 public:
     // Methods from ::android::hardware::automotive::vehicle::V2_0::IVehicleCallback follow.
-    Return<void> onPropertyEvent(const hidl_vec <VehiclePropValue> & /*values*/) override {
+    Return<void> onPropertyEvent(const hidl_vec <VehiclePropValue> & values) override {
         {
-            // Our use case is so simple, we don't actually need to update a variable,
-            // but the docs seem to say we have to take the lock anyway to keep
-            // the condition variable implementation happy.
+            // Only the latest value of each property matters, so a newer one replaces any
+            // that run() hasn't passed on yet
             std::lock_guard<std::mutex> g(mLock);
+            for (auto&& value : values) {
+                if (value.value.int32Values.size() > 0) {
+                    mPendingValues[value.prop] = value.value.int32Values[0];
+                }
+            }
         }
         mEventCond.notify_one();
         return Return<void>();
@@ -50,31 +57,43 @@ public:
         return Return<void>();
     }
 
-    bool waitForEvents(int timeout_ms) {
-        std::unique_lock<std::mutex> g(mLock);
-        std::cv_status result = mEventCond.wait_for(g, std::chrono::milliseconds(timeout_ms));
-        return (result == std::cv_status::no_timeout);
-    }
-
     void run(EvsStateControl *pStateController) {
         while (true) {
             // Wait until we have an event to which to react
-            // (wake up and validate our current state "just in case" every so often)
-            waitForEvents(5000);
+            // (wake up and have the state checked "just in case" every so often)
+            std::map<int32_t, int32_t> values;
+            bool gotEvents;
+            {
+                std::unique_lock<std::mutex> g(mLock);
+                gotEvents = mEventCond.wait_for(g, std::chrono::milliseconds(5000),
+                                                [this](){ return !mPendingValues.empty(); });
+                values.swap(mPendingValues);
+            }
+
+            if (!gotEvents) {
+                EvsStateControl::Command cmd = {
+                    .operation = EvsStateControl::Op::CHECK_VEHICLE_STATE,
+                    .arg1      = 0,
+                    .arg2      = 0,
+                };
+                pStateController->postCommand(cmd);
+            }
 
-            // If we were delivered an event (or it's been a while) update as necessary
-            EvsStateControl::Command cmd = {
-                .operation = EvsStateControl::Op::CHECK_VEHICLE_STATE,
-                .arg1      = 0,
-                .arg2      = 0,
-            };
-            pStateController->postCommand(cmd);
+            for (auto&& value : values) {
+                EvsStateControl::Command cmd = {
+                    .operation = EvsStateControl::Op::PROPERTY_EVENT,
+                    .arg1      = static_cast<uint32_t>(value.first),
+                    .arg2      = static_cast<uint32_t>(value.second),
+                };
+                pStateController->postCommand(cmd);
+            }
         }
     }
 
 private:
     std::mutex mLock;
     std::condition_variable mEventCond;
+    std::map<int32_t, int32_t> mPendingValues;  // Latest int32 value by property ID
 };
 
 #endif //CAR_EVS_APP_VEHICLELISTENER_H
@@ -26,14 +26,17 @@
 using ::android::GraphicBuffer;
 
 
+// The display only has a few buffers to hand out.  Past this many we assume some of ours are
+// gone, and let go of the ones we've gone longest without seeing.
+static const unsigned kMaxRenderTargets = 8;
+
+
 // OpenGL state shared among all renderers
 EGLDisplay   RenderBase::sDisplay = EGL_NO_DISPLAY;
 EGLContext   RenderBase::sContext = EGL_NO_CONTEXT;
 EGLSurface   RenderBase::sDummySurface = EGL_NO_SURFACE;
-GLuint       RenderBase::sFrameBuffer = -1;
-GLuint       RenderBase::sColorBuffer = -1;
 GLuint       RenderBase::sDepthBuffer = -1;
-EGLImageKHR  RenderBase::sKHRimage = EGL_NO_IMAGE_KHR;
+BufferCache<RenderBase::RenderTarget> RenderBase::sRenderTargets(RenderBase::releaseRenderTarget);
 unsigned     RenderBase::sWidth  = 0;
 unsigned     RenderBase::sHeight = 0;
 float        RenderBase::sAspectRatio = 0.0f;
@@ -121,14 +124,10 @@ bool RenderBase::prepareGL() {
     ALOGI("GL EXTENSIONS:\n  %s", gl_extensions);
 
 
-    // Reserve handles for the color and depth targets we'll be setting up
-    glGenRenderbuffers(1, &sColorBuffer);
+    // Reserve a handle for the depth target we'll be setting up.  The color targets, and the
+    // frame buffer objects we use for off screen rendering, are made for each display buffer.
     glGenRenderbuffers(1, &sDepthBuffer);
 
-    // Set up the frame buffer object we can modify and use for off screen rendering
-    glGenFramebuffers(1, &sFrameBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, sFrameBuffer);
-
 
     // Now that we're assured success, store object handles we constructed
     sDisplay = display;
@@ -145,6 +144,46 @@ bool RenderBase::attachRenderTarget(const BufferDesc& tgtBuffer) {
         return false;
     }
 
+    // The display cycles through a few buffers, each of which we only need to set up once
+    RenderTarget* target = sRenderTargets.find(tgtBuffer);
+    if (target == nullptr) {
+        target = createRenderTarget(tgtBuffer);
+        if (target == nullptr) {
+            return false;
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, target->frameBuffer);
+
+    // Store the size of our target buffer
+    sWidth = tgtBuffer.width;
+    sHeight = tgtBuffer.height;
+    sAspectRatio = (float)sWidth / sHeight;
+
+    // Set the viewport
+    glViewport(0, 0, sWidth, sHeight);
+
+#if 1   // We don't actually need the clear if we're going to cover the whole screen anyway
+    // Clear the color buffer
+    glClearColor(0.8f, 0.1f, 0.2f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+#endif
+
+
+    return true;
+}
+
+
+void RenderBase::detachRenderTarget() {
+    // Nothing to do, since we keep our external render targets set up for their next use
+}
+
+
+RenderBase::RenderTarget* RenderBase::createRenderTarget(const BufferDesc& tgtBuffer) {
+    // Make room if we seem to have lost track of the display's buffers
+    while (sRenderTargets.size() >= kMaxRenderTargets) {
+        sRenderTargets.releaseOldest();
+    }
+
     // create a GraphicBuffer from the existing handle
     sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(tgtBuffer.memHandle,
                                                      GraphicBuffer::CLONE_HANDLE,
@@ -154,64 +193,67 @@ bool RenderBase::attachRenderTarget(const BufferDesc& tgtBuffer) {
                                                      tgtBuffer.stride);
     if (pGfxBuffer.get() == nullptr) {
         ALOGE("Failed to allocate GraphicBuffer to wrap image handle");
-        return false;
+        return nullptr;
     }
 
     // Get a GL compatible reference to the graphics buffer we've been given
+    RenderTarget target;
     EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
     EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-    sKHRimage = eglCreateImageKHR(sDisplay, EGL_NO_CONTEXT,
-                                  EGL_NATIVE_BUFFER_ANDROID, clientBuf,
-                                  eglImageAttributes);
-    if (sKHRimage == EGL_NO_IMAGE_KHR) {
+    target.image = eglCreateImageKHR(sDisplay, EGL_NO_CONTEXT,
+                                     EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                     eglImageAttributes);
+    if (target.image == EGL_NO_IMAGE_KHR) {
         ALOGE("error creating EGLImage for target buffer: %s", getEGLError());
-        return false;
+        return nullptr;
     }
 
     // Construct a render buffer around the external buffer
-    glBindRenderbuffer(GL_RENDERBUFFER, sColorBuffer);
-    glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER, static_cast<GLeglImageOES>(sKHRimage));
+    glGenRenderbuffers(1, &target.colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.colorBuffer);
+    glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER,
+                                           static_cast<GLeglImageOES>(target.image));
     if (eglGetError() != EGL_SUCCESS) {
         ALOGI("glEGLImageTargetRenderbufferStorageOES => %s", getEGLError());
-        return false;
+        releaseRenderTarget(&target);
+        return nullptr;
     }
 
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sColorBuffer);
+    // And a frame buffer object to render into it with
+    glGenFramebuffers(1, &target.frameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.frameBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              target.colorBuffer);
     if (eglGetError() != EGL_SUCCESS) {
         ALOGE("glFramebufferRenderbuffer => %s", getEGLError());
-        return false;
+        releaseRenderTarget(&target);
+        return nullptr;
     }
 
     GLenum checkResult = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (checkResult != GL_FRAMEBUFFER_COMPLETE) {
         ALOGE("Offscreen framebuffer not configured successfully (%d: %s)",
               checkResult, getGLFramebufferError());
-        return false;
+        releaseRenderTarget(&target);
+        return nullptr;
     }
 
-    // Store the size of our target buffer
-    sWidth = tgtBuffer.width;
-    sHeight = tgtBuffer.height;
-    sAspectRatio = (float)sWidth / sHeight;
-
-    // Set the viewport
-    glViewport(0, 0, sWidth, sHeight);
-
-#if 1   // We don't actually need the clear if we're going to cover the whole screen anyway
-    // Clear the color buffer
-    glClearColor(0.8f, 0.1f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-#endif
-
-
-    return true;
+    return sRenderTargets.add(tgtBuffer, target);
 }
 
 
-void RenderBase::detachRenderTarget() {
-    // Drop our external render target
-    if (sKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(sDisplay, sKHRimage);
-        sKHRimage = EGL_NO_IMAGE_KHR;
+void RenderBase::releaseRenderTarget(RenderTarget* target) {
+    if (target->frameBuffer != 0) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &target->frameBuffer);
+        target->frameBuffer = 0;
     }
-}
\ No newline at end of file
+    if (target->colorBuffer != 0) {
+        glDeleteRenderbuffers(1, &target->colorBuffer);
+        target->colorBuffer = 0;
+    }
+    if (target->image != EGL_NO_IMAGE_KHR) {
+        eglDestroyImageKHR(sDisplay, target->image);
+        target->image = EGL_NO_IMAGE_KHR;
+    }
+}
@@ -26,6 +26,8 @@
 
 #include <android/hardware/automotive/evs/1.0/IEvsEnumerator.h>
 
+#include "BufferCache.h"
+
 using namespace ::android::hardware::automotive::evs::V1_0;
 using ::android::sp;
 
@@ -43,6 +45,10 @@ public:
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer) = 0;
 
+    // Lets go of the framebuffers we've kept for the display's buffers.  Call whenever the
+    // display may have reissued them, since it's free to send new buffers under the old IDs.
+    static void releaseRenderTargets()  { sRenderTargets.clear(); };
+
 protected:
     static bool prepareGL();
 
@@ -53,11 +59,19 @@ protected:
     static EGLDisplay   sDisplay;
     static EGLContext   sContext;
     static EGLSurface   sDummySurface;
-    static GLuint       sFrameBuffer;
-    static GLuint       sColorBuffer;
     static GLuint       sDepthBuffer;
 
-    static EGLImageKHR  sKHRimage;
+    // A display buffer set up as a framebuffer we can render into, kept for the next time the
+    // display hands us the same buffer
+    struct RenderTarget {
+        EGLImageKHR     image = EGL_NO_IMAGE_KHR;
+        GLuint          colorBuffer = 0;
+        GLuint          frameBuffer = 0;
+    };
+    static RenderTarget* createRenderTarget(const BufferDesc& tgtBuffer);
+    static void releaseRenderTarget(RenderTarget* target);
+
+    static BufferCache<RenderTarget> sRenderTargets;
 
     static unsigned     sWidth;
     static unsigned     sHeight;
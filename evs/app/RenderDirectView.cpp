@@ -19,11 +19,15 @@
 #include "glError.h"
 #include "shader.h"
 #include "shader_simpleTex.h"
+#include "EvsExtendedInfo.h"
 
 #include <log/log.h>
 #include <math/mat4.h>
 
 
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_SYNC_GROUP;
+
+
 RenderDirectView::RenderDirectView(sp<IEvsEnumerator> enumerator,
                                    const ConfigManager::CameraInfo& cam) {
     mEnumerator = enumerator;
@@ -50,12 +54,18 @@ bool RenderDirectView::activate() {
     }
 
     // Construct our video texture
-    mTexture.reset(createVideoTexture(mEnumerator, mCameraInfo.cameraId.c_str(), sDisplay));
+    mTexture = acquireVideoTexture(mEnumerator, mCameraInfo.cameraId.c_str(), sDisplay);
     if (!mTexture) {
         ALOGE("Failed to set up video texture for %s (%s)",
               mCameraInfo.cameraId.c_str(), mCameraInfo.function.c_str());
 // TODO:  For production use, we may actually want to fail in this case, but not yet...
 //       return false;
+    } else {
+        // A top view we shared the camera with may have left it waiting on the others
+        sp<IEvsCamera> pCamera = mTexture->getCamera();
+        if (pCamera->getExtendedInfo(EXTENDED_INFO_CLIENT_SYNC_GROUP) != 0) {
+            pCamera->setExtendedInfo(EXTENDED_INFO_CLIENT_SYNC_GROUP, 0);
+        }
     }
 
     return true;
@@ -63,9 +73,8 @@ bool RenderDirectView::activate() {
 
 
 void RenderDirectView::deactivate() {
-    // Release our video texture
-    // We can't hold onto it because some other Render object might need the same camera
-    // TODO:  If start/stop costs become a problem, we could share video textures
+    // Release our video texture.  Its stream is kept going for a while in case the next
+    // renderer (or we, once reactivated) want the same camera.
     mTexture = nullptr;
 }
 
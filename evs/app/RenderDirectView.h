@@ -44,7 +44,7 @@ protected:
     sp<IEvsEnumerator>              mEnumerator;
     ConfigManager::CameraInfo       mCameraInfo;
 
-    std::unique_ptr<VideoTex>       mTexture;
+    std::shared_ptr<VideoTex>       mTexture;
 
     GLuint                          mShaderProgram = 0;
 };
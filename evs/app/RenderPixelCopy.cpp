@@ -16,10 +16,14 @@
 
 #include "RenderPixelCopy.h"
 #include "FormatConvert.h"
+#include "EvsExtendedInfo.h"
 
 #include <log/log.h>
 
 
+using namespace ::android::automotive::evs::support;
+
+
 RenderPixelCopy::RenderPixelCopy(sp<IEvsEnumerator> enumerator,
                                    const ConfigManager::CameraInfo& cam) {
     mEnumerator = enumerator;
@@ -35,6 +39,24 @@ bool RenderPixelCopy::activate() {
         return false;
     }
 
+    // Tell the camera about any color settings our configuration overrides, then match our own
+    // conversion to whatever the camera reports it is using.  (Cameras which don't know about
+    // these settings report zero, which is BT.601 limited range.)
+    if (mCameraInfo.colorMatrix >= 0) {
+        pCamera->setExtendedInfo(EXTENDED_INFO_COLOR_MATRIX, mCameraInfo.colorMatrix);
+    }
+    if (mCameraInfo.colorRange >= 0) {
+        pCamera->setExtendedInfo(EXTENDED_INFO_COLOR_RANGE, mCameraInfo.colorRange);
+    }
+    int32_t matrix = pCamera->getExtendedInfo(EXTENDED_INFO_COLOR_MATRIX);
+    int32_t range  = pCamera->getExtendedInfo(EXTENDED_INFO_COLOR_RANGE);
+    mColorConverter.configure(static_cast<ColorMatrix>(matrix), static_cast<ColorRange>(range));
+
+    // Have the EVS manager hand us frames in our display's format if it can, converted once for
+    // all its clients wanting that format, leaving us a plain copy.  Without the manager in
+    // between this is turned down and we convert the frames ourselves.
+    pCamera->setExtendedInfo(EXTENDED_INFO_CLIENT_FORMAT, HAL_PIXEL_FORMAT_RGBA_8888);
+
     // Initialize the stream that will help us update this texture's contents
     sp<StreamHandler> pStreamHandler = new StreamHandler(pCamera);
     if (pStreamHandler.get() == nullptr) {
@@ -101,15 +123,18 @@ bool RenderPixelCopy::drawFrame(const BufferDesc& tgtBuffer) {
                 if (srcBuffer.format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {   // 420SP == NV21
                     copyNV21toRGB32(width, height,
                                     srcPixels,
-                                    tgtPixels, tgtBuffer.stride);
+                                    tgtPixels, tgtBuffer.stride,
+                                    mColorConverter);
                 } else if (srcBuffer.format == HAL_PIXEL_FORMAT_YV12) { // YUV_420P == YV12
                     copyYV12toRGB32(width, height,
                                     srcPixels,
-                                    tgtPixels, tgtBuffer.stride);
+                                    tgtPixels, tgtBuffer.stride,
+                                    mColorConverter);
                 } else if (srcBuffer.format == HAL_PIXEL_FORMAT_YCBCR_422_I) { // YUYV
                     copyYUYVtoRGB32(width, height,
                                     srcPixels, srcBuffer.stride,
-                                    tgtPixels, tgtBuffer.stride);
+                                    tgtPixels, tgtBuffer.stride,
+                                    mColorConverter);
                 } else if (srcBuffer.format == tgtBuffer.format) {  // 32bit RGBA
                     copyMatchedInterleavedFormats(width, height,
                                                   srcPixels, srcBuffer.stride,
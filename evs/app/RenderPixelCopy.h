@@ -23,6 +23,7 @@
 #include <android/hardware/automotive/evs/1.0/IEvsEnumerator.h>
 #include "ConfigManager.h"
 #include "VideoTex.h"
+#include "ColorConvert.h"
 
 
 using namespace ::android::hardware::automotive::evs::V1_0;
@@ -45,6 +46,8 @@ protected:
     ConfigManager::CameraInfo       mCameraInfo;
 
     sp<StreamHandler>               mStreamHandler;
+
+    ::android::automotive::evs::support::ColorConverter mColorConverter;
 };
 
 
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures what it costs a renderer to point GL at the display's next target buffer, with the
+// framebuffers RenderBase keeps for each display buffer, and the way it used to be done: one
+// framebuffer and renderbuffer for every target, with a new EGLImage bound to them each frame.
+
+#include <benchmark/benchmark.h>
+
+#include <log/log.h>
+#include <ui/GraphicBuffer.h>
+#include <ui/GraphicBufferAllocator.h>
+
+#include <vector>
+
+#include "RenderBase.h"
+
+using ::android::GraphicBuffer;
+using ::android::GraphicBufferAllocator;
+
+
+// The display hands out its buffers in turn, usually from a small set like this one
+static const unsigned kDisplayBuffers = 3;
+static const unsigned kWidth = 1280;
+static const unsigned kHeight = 720;
+
+
+// Gives us access to RenderBase's render target handling
+class TargetBench : public RenderBase {
+public:
+    bool activate() override    { return true; };
+    void deactivate() override  {};
+    bool drawFrame(const BufferDesc&) override  { return true; };
+
+    static bool prepare()                       { return prepareGL(); };
+    static bool attach(const BufferDesc& buf)   { return attachRenderTarget(buf); };
+    static void detach()                        { detachRenderTarget(); };
+
+    // attachRenderTarget() and detachRenderTarget() as they were before the targets were kept
+    static bool prepareOld();
+    static bool attachOld(const BufferDesc& tgtBuffer);
+    static void detachOld();
+    static void releaseOld();
+
+private:
+    static GLuint       sOldFrameBuffer;
+    static GLuint       sOldColorBuffer;
+    static EGLImageKHR  sOldImage;
+};
+
+GLuint       TargetBench::sOldFrameBuffer = 0;
+GLuint       TargetBench::sOldColorBuffer = 0;
+EGLImageKHR  TargetBench::sOldImage = EGL_NO_IMAGE_KHR;
+
+
+bool TargetBench::prepareOld() {
+    if (!prepareGL()) {
+        return false;
+    }
+
+    // These were made once, by prepareGL()
+    glGenRenderbuffers(1, &sOldColorBuffer);
+    glGenFramebuffers(1, &sOldFrameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, sOldFrameBuffer);
+    return true;
+}
+
+
+bool TargetBench::attachOld(const BufferDesc& tgtBuffer) {
+    // create a GraphicBuffer from the existing handle
+    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(tgtBuffer.memHandle,
+                                                     GraphicBuffer::CLONE_HANDLE,
+                                                     tgtBuffer.width, tgtBuffer.height,
+                                                     tgtBuffer.format, 1, // layer count
+                                                     GRALLOC_USAGE_HW_RENDER,
+                                                     tgtBuffer.stride);
+    if (pGfxBuffer.get() == nullptr) {
+        return false;
+    }
+
+    // Get a GL compatible reference to the graphics buffer we've been given
+    EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
+    sOldImage = eglCreateImageKHR(sDisplay, EGL_NO_CONTEXT,
+                                  EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                  eglImageAttributes);
+    if (sOldImage == EGL_NO_IMAGE_KHR) {
+        return false;
+    }
+
+    // Construct a render buffer around the external buffer
+    glBindRenderbuffer(GL_RENDERBUFFER, sOldColorBuffer);
+    glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER, static_cast<GLeglImageOES>(sOldImage));
+    if (eglGetError() != EGL_SUCCESS) {
+        return false;
+    }
+
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              sOldColorBuffer);
+    if (eglGetError() != EGL_SUCCESS) {
+        return false;
+    }
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        return false;
+    }
+
+    glViewport(0, 0, tgtBuffer.width, tgtBuffer.height);
+    glClearColor(0.8f, 0.1f, 0.2f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    return true;
+}
+
+
+void TargetBench::detachOld() {
+    // Drop our external render target
+    if (sOldImage != EGL_NO_IMAGE_KHR) {
+        eglDestroyImageKHR(sDisplay, sOldImage);
+        sOldImage = EGL_NO_IMAGE_KHR;
+    }
+}
+
+
+void TargetBench::releaseOld() {
+    detachOld();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &sOldFrameBuffer);
+    glDeleteRenderbuffers(1, &sOldColorBuffer);
+    sOldFrameBuffer = 0;
+    sOldColorBuffer = 0;
+}
+
+
+// Display buffers like the ones EvsGlDisplay allocates
+static const std::vector<BufferDesc>& getDisplayBuffers() {
+    static std::vector<BufferDesc> buffers;
+    if (buffers.empty()) {
+        for (unsigned i = 0; i < kDisplayBuffers; i++) {
+            const uint32_t usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_COMPOSER;
+            buffer_handle_t handle = nullptr;
+            uint32_t pixelsPerLine = 0;
+            status_t result = GraphicBufferAllocator::get().allocate(kWidth, kHeight,
+                                                                     HAL_PIXEL_FORMAT_RGBA_8888,
+                                                                     1, usage,
+                                                                     &handle, &pixelsPerLine, 0,
+                                                                     "EvsAppBenchmark");
+            if (result != NO_ERROR || !handle) {
+                ALOGE("Error %d allocating display buffer for the benchmark", result);
+                break;
+            }
+
+            BufferDesc buffer = {};
+            buffer.width = kWidth;
+            buffer.height = kHeight;
+            buffer.stride = pixelsPerLine;
+            buffer.format = HAL_PIXEL_FORMAT_RGBA_8888;
+            buffer.usage = usage;
+            buffer.bufferId = i;
+            buffer.memHandle = handle;
+            buffers.push_back(buffer);
+        }
+    }
+    return buffers;
+}
+
+
+static void BM_AttachKeptTarget(benchmark::State& state) {
+    const std::vector<BufferDesc>& buffers = getDisplayBuffers();
+    if (buffers.size() != kDisplayBuffers || !TargetBench::prepare()) {
+        state.SkipWithError("Couldn't set up GL and the display buffers");
+        return;
+    }
+
+    unsigned frame = 0;
+    while (state.KeepRunning()) {
+        if (!TargetBench::attach(buffers[frame++ % buffers.size()])) {
+            state.SkipWithError("attachRenderTarget failed");
+            break;
+        }
+
+        // Wait for the target's clear, so its setup can't hide in the driver's queue
+        glFinish();
+        TargetBench::detach();
+    }
+
+    TargetBench::releaseRenderTargets();
+}
+BENCHMARK(BM_AttachKeptTarget);
+
+
+static void BM_AttachNewTarget(benchmark::State& state) {
+    const std::vector<BufferDesc>& buffers = getDisplayBuffers();
+    if (buffers.size() != kDisplayBuffers || !TargetBench::prepareOld()) {
+        state.SkipWithError("Couldn't set up GL and the display buffers");
+        return;
+    }
+
+    unsigned frame = 0;
+    while (state.KeepRunning()) {
+        if (!TargetBench::attachOld(buffers[frame++ % buffers.size()])) {
+            state.SkipWithError("attachRenderTarget failed");
+            break;
+        }
+
+        glFinish();
+        TargetBench::detachOld();
+    }
+
+    TargetBench::releaseOld();
+}
+BENCHMARK(BM_AttachNewTarget);
+
+
+BENCHMARK_MAIN();
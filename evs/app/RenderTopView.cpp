@@ -20,10 +20,16 @@
 #include "shader.h"
 #include "shader_simpleTex.h"
 #include "shader_projectedTex.h"
+#include "EvsExtendedInfo.h"
 
 #include <log/log.h>
 #include <math/mat4.h>
 #include <math/vec3.h>
+#include <unistd.h>
+
+
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_SYNC_GROUP;
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_SYNC_TOLERANCE_US;
 
 
 // Simple aliases to make geometric math using vectors more readable
@@ -33,6 +39,15 @@ static const unsigned Z = 2;
 //static const unsigned W = 3;
 
 
+// How far apart (in arrival time) the frames of the cameras may be and still be shown together.
+// Half a frame at 30fps.
+static const int32_t kSyncToleranceUs = 16000;
+
+// How long we'll keep showing the old images from every camera while one of them has yet to
+// deliver its part of the new set
+static const std::chrono::milliseconds kMaxSetWait(100);
+
+
 // Since we assume no roll in these views, we can simplify the required math
 static android::vec3 unitVectorFromPitchAndYaw(float pitch, float yaw) {
     float sinPitch, cosPitch;
@@ -113,43 +128,51 @@ bool RenderTopView::activate() {
         return false;
     }
 
-    // Load our shader programs
-    mPgmAssets.simpleTexture = buildShaderProgram(vtxShader_simpleTexture,
-                                                 pixShader_simpleTexture,
-                                                 "simpleTexture");
+    // Load our shader programs, unless we still have them from an earlier activation
     if (!mPgmAssets.simpleTexture) {
-        ALOGE("Failed to build shader program");
-        return false;
+        mPgmAssets.simpleTexture = buildShaderProgram(vtxShader_simpleTexture,
+                                                     pixShader_simpleTexture,
+                                                     "simpleTexture");
+        if (!mPgmAssets.simpleTexture) {
+            ALOGE("Failed to build shader program");
+            return false;
+        }
     }
-    mPgmAssets.projectedTexture = buildShaderProgram(vtxShader_projectedTexture,
-                                                    pixShader_projectedTexture,
-                                                    "projectedTexture");
     if (!mPgmAssets.projectedTexture) {
-        ALOGE("Failed to build shader program");
-        return false;
+        mPgmAssets.projectedTexture = buildShaderProgram(vtxShader_projectedTexture,
+                                                        pixShader_projectedTexture,
+                                                        "projectedTexture");
+        if (!mPgmAssets.projectedTexture) {
+            ALOGE("Failed to build shader program");
+            return false;
+        }
     }
 
 
     // Load the checkerboard text image
-    mTexAssets.checkerBoard.reset(createTextureFromPng(
-                                  "/system/etc/automotive/evs/LabeledChecker.png"));
     if (!mTexAssets.checkerBoard) {
-        ALOGE("Failed to load checkerboard texture");
-        return false;
+        mTexAssets.checkerBoard.reset(createTextureFromPng(
+                                      "/system/etc/automotive/evs/LabeledChecker.png"));
+        if (!mTexAssets.checkerBoard) {
+            ALOGE("Failed to load checkerboard texture");
+            return false;
+        }
     }
 
     // Load the car image
-    mTexAssets.carTopView.reset(createTextureFromPng(
-                                "/system/etc/automotive/evs/CarFromTop.png"));
     if (!mTexAssets.carTopView) {
-        ALOGE("Failed to load carTopView texture");
-        return false;
+        mTexAssets.carTopView.reset(createTextureFromPng(
+                                    "/system/etc/automotive/evs/CarFromTop.png"));
+        if (!mTexAssets.carTopView) {
+            ALOGE("Failed to load carTopView texture");
+            return false;
+        }
     }
 
 
     // Set up streaming video textures for our associated cameras
     for (auto&& cam: mActiveCameras) {
-        cam.tex.reset(createVideoTexture(mEnumerator, cam.info.cameraId.c_str(), sDisplay));
+        cam.tex = acquireVideoTexture(mEnumerator, cam.info.cameraId.c_str(), sDisplay);
         if (!cam.tex) {
             ALOGE("Failed to set up video texture for %s (%s)",
                   cam.info.cameraId.c_str(), cam.info.function.c_str());
@@ -157,15 +180,16 @@ bool RenderTopView::activate() {
 //            return false;
         }
     }
+    groupCameras();
+    mSetPending = false;
 
     return true;
 }
 
 
 void RenderTopView::deactivate() {
-    // Release our video textures
-    // We can't hold onto it because some other Render object might need the same camera
-    // TODO:  If start/stop costs become a problem, we could share video textures
+    // Release our video textures.  Their streams are kept going for a while in case the next
+    // renderer (or we, once reactivated) want the same cameras.
     for (auto&& cam: mActiveCameras) {
         cam.tex = nullptr;
     }
@@ -196,13 +220,8 @@ bool RenderTopView::drawFrame(const BufferDesc& tgtBuffer) {
     orthoMatrix = android::mat4::ortho(left, right, top, bottom, near, far);
 
 
-    // Refresh our video texture contents.  We do it all at once in hopes of getting
-    // better coherence among images.  This does not guarantee synchronization, of course...
-    for (auto&& cam: mActiveCameras) {
-        if (cam.tex) {
-            cam.tex->refresh();
-        }
-    }
+    // Refresh our video texture contents
+    refreshVideoTextures();
 
     // Iterate over all the cameras and project their images onto the ground plane
     for (auto&& cam: mActiveCameras) {
@@ -222,6 +241,77 @@ bool RenderTopView::drawFrame(const BufferDesc& tgtBuffer) {
 }
 
 
+// Asks the EVS manager to pass on the frames of our cameras in sets taken at about the same
+// time, so the images we stitch together agree with each other along the seams
+void RenderTopView::groupCameras() {
+    // The ID only has to be unique among the manager's clients, and must not be zero
+    static int32_t sGroupCount = 0;
+    const int32_t groupId = ((getpid() & 0x7FFFFF) << 8) | (++sGroupCount & 0xFF);
+
+    unsigned cameraCount = 0;
+    for (auto&& cam: mActiveCameras) {
+        if (cam.tex) {
+            cameraCount++;
+        }
+    }
+    if (cameraCount < 2) {
+        // Nothing to synchronize with
+        return;
+    }
+
+    for (auto&& cam: mActiveCameras) {
+        if (!cam.tex) {
+            continue;
+        }
+        sp<IEvsCamera> pCamera = cam.tex->getCamera();
+        if (pCamera->setExtendedInfo(EXTENDED_INFO_CLIENT_SYNC_GROUP, groupId) != EvsResult::OK) {
+            // Without the manager in between, we just show frames as they come
+            ALOGI("Camera %s can't be synchronized with the others", cam.info.cameraId.c_str());
+            continue;
+        }
+        pCamera->setExtendedInfo(EXTENDED_INFO_CLIENT_SYNC_TOLERANCE_US, kSyncToleranceUs);
+    }
+}
+
+
+// Moves all the video textures on to their new frames together, once every camera has one.
+// Frames arrive from the grouped cameras in sets, but not all in the same instant, so without
+// this we could draw some cameras' images from one set beside others' from the one before.
+// A camera which has stalled can only hold up the others for so long.
+void RenderTopView::refreshVideoTextures() {
+    bool anyReady = false;
+    bool allReady = true;
+    for (auto&& cam: mActiveCameras) {
+        if (cam.tex) {
+            if (cam.tex->hasNewFrame()) {
+                anyReady = true;
+            } else {
+                allReady = false;
+            }
+        }
+    }
+    if (!anyReady) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!mSetPending) {
+        mSetPending = true;
+        mSetPendingSince = now;
+    }
+    if (!allReady && (now - mSetPendingSince < kMaxSetWait)) {
+        return;
+    }
+
+    for (auto&& cam: mActiveCameras) {
+        if (cam.tex) {
+            cam.tex->refresh();
+        }
+    }
+    mSetPending = false;
+}
+
+
 //
 // Responsible for drawing the car's self image in the top down view.
 // Draws in car model space (units of meters with origin at center of rear axel)
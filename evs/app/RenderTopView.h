@@ -26,6 +26,8 @@
 #include "VideoTex.h"
 #include <math/mat4.h>
 
+#include <chrono>
+
 
 using namespace ::android::hardware::automotive::evs::V1_0;
 
@@ -47,11 +49,13 @@ public:
 protected:
     struct ActiveCamera {
         const ConfigManager::CameraInfo&    info;
-        std::unique_ptr<VideoTex>           tex;
+        std::shared_ptr<VideoTex>           tex;
 
         ActiveCamera(const ConfigManager::CameraInfo& c) : info(c) {};
     };
 
+    void groupCameras();
+    void refreshVideoTextures();
     void renderCarTopView();
     void renderCameraOntoGroundPlane(const ActiveCamera& cam);
 
@@ -65,11 +69,16 @@ protected:
     } mTexAssets;
 
     struct {
-        GLuint simpleTexture;
-        GLuint projectedTexture;
+        GLuint simpleTexture = 0;
+        GLuint projectedTexture = 0;
     } mPgmAssets;
 
     android::mat4   orthoMatrix;
+
+    // When the first of the cameras had a new frame waiting, if we're holding off updating any
+    // of the textures until they all do
+    bool                                    mSetPending = false;
+    std::chrono::steady_clock::time_point   mSetPendingSince;
 };
 
 
@@ -23,12 +23,20 @@
 #include <cutils/native_handle.h>
 
 
+std::function<void()> StreamHandler::sFrameListener;
+
+
+void StreamHandler::setFrameListener(std::function<void()> listener) {
+    sFrameListener = listener;
+}
+
+
 StreamHandler::StreamHandler(android::sp <IEvsCamera> pCamera) :
     mCamera(pCamera)
 {
     // We rely on the camera having at least two buffers available since we'll hold one and
     // expect the camera to be able to capture a new image in the background.
-    pCamera->setMaxFramesInFlight(2);
+    setMaxFramesInFlight(2);
 }
 
 
@@ -55,12 +63,20 @@ bool StreamHandler::startStream() {
 
         // Mark ourselves as running
         mRunning = true;
+        mBufferGeneration++;
     }
 
     return true;
 }
 
 
+bool StreamHandler::setMaxFramesInFlight(uint32_t bufferCount) {
+    Return<EvsResult> result = mCamera->setMaxFramesInFlight(bufferCount);
+    mBufferGeneration++;
+    return result.isOk() && result == EvsResult::OK;
+}
+
+
 void StreamHandler::asyncStopStream() {
     // Tell the camera to stop streaming.
     // This will result in a null frame being delivered when the stream actually stops.
@@ -128,6 +144,17 @@ void StreamHandler::doneWithFrame(const BufferDesc& buffer) {
 }
 
 
+// Sends the ready frame, if any, back to the camera unseen
+void StreamHandler::discardNewFrame() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    if (mReadyBuffer >= 0) {
+        mCamera->doneWithFrame(mBuffers[mReadyBuffer]);
+        mReadyBuffer = -1;
+    }
+}
+
+
 Return<void> StreamHandler::deliverFrame(const BufferDesc& buffer) {
     ALOGD("Received a frame from the camera (%p)", buffer.memHandle.getNativeHandle());
 
@@ -160,6 +187,9 @@ Return<void> StreamHandler::deliverFrame(const BufferDesc& buffer) {
 
     // Notify anybody who cares that things have changed
     mSignal.notify_all();
+    if (sFrameListener && mNotifyFrames) {
+        sFrameListener();
+    }
 
     return Void();
 }
@@ -17,6 +17,8 @@
 #ifndef EVS_VTS_STREAMHANDLER_H
 #define EVS_VTS_STREAMHANDLER_H
 
+#include <atomic>
+#include <functional>
 #include <queue>
 
 #include "ui/GraphicBuffer.h"
@@ -53,16 +55,37 @@ public:
 
     bool isRunning();
 
+    // Changes how many frames we may hold at once.  The camera may give us a new set of buffers
+    // under the IDs of the old ones afterwards.
+    bool setMaxFramesInFlight(uint32_t bufferCount);
+
+    // Changes whenever the camera may have reissued its buffers, each time our stream starts or
+    // our frame allowance changes, so that whatever was built around the old ones can be dropped
+    unsigned getBufferGeneration()  { return mBufferGeneration; };
+
     bool newFrameAvailable();
     const BufferDesc& getNewFrame();
     void doneWithFrame(const BufferDesc& buffer);
+    void discardNewFrame();
+
+    // Called on the delivery thread whenever any of our streams gets a frame, so that whoever
+    // draws them can sleep until there's something new.  Set it before starting any stream.
+    static void setFrameListener(std::function<void()> listener);
+
+    // Whether this stream's frames are reported to the frame listener.  Streams kept running for
+    // nobody in particular needn't wake anyone.
+    void setFrameNotifications(bool enabled)    { mNotifyFrames = enabled; };
 
 private:
     // Implementation for ::android::hardware::automotive::evs::V1_0::ICarCameraStream
     Return<void> deliverFrame(const BufferDesc& buffer)  override;
 
+    static std::function<void()> sFrameListener;
+
     // Values initialized as startup
     android::sp <IEvsCamera>    mCamera;
+    std::atomic<bool>           mNotifyFrames{true};
+    std::atomic<unsigned>       mBufferGeneration{0};
 
     // Since we get frames delivered to us asnchronously via the ICarCameraStream interface,
     // we need to protect all member variables that may be modified while we're streaming
@@ -13,6 +13,8 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <map>
+#include <string>
 #include <vector>
 #include <stdio.h>
 #include <fcntl.h>
@@ -24,6 +26,7 @@
 
 #include "VideoTex.h"
 #include "glError.h"
+#include "EvsExtendedInfo.h"
 
 #include <ui/GraphicBuffer.h>
 
@@ -32,6 +35,15 @@
 // and this is our work around.
 using ::android::GraphicBuffer;
 
+using ::android::automotive::evs::support::EXTENDED_INFO_STREAM_RESTARTS;
+
+
+// A buffer the camera hasn't given us for this many frames is assumed to be gone for good
+static const unsigned kMaxUnusedFrames = 64;
+
+// How often we ask whether the stream behind our camera has been restarted
+static const std::chrono::seconds kRestartCheckInterval(1);
+
 
 VideoTex::VideoTex(sp<IEvsEnumerator> pEnum,
                    sp<IEvsCamera> pCamera,
@@ -41,8 +53,11 @@ VideoTex::VideoTex(sp<IEvsEnumerator> pEnum,
     , mEnumerator(pEnum)
     , mCamera(pCamera)
     , mStreamHandler(pStreamHandler)
-    , mDisplay(glDisplay) {
-    // Nothing but initialization here...
+    , mDisplay(glDisplay)
+    , mImages([this](CachedImage* cached){ releaseImage(cached); }) {
+    // Until the first frame arrives we show the empty texture our base class made
+    mEmptyTexId = id;
+    mBufferGeneration = mStreamHandler->getBufferGeneration();
 }
 
 VideoTex::~VideoTex() {
@@ -52,11 +67,11 @@ VideoTex::~VideoTex() {
     // Close the camera
     mEnumerator->closeCamera(mCamera);
 
-    // Drop our device texture image
-    if (mKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(mDisplay, mKHRimage);
-        mKHRimage = EGL_NO_IMAGE_KHR;
-    }
+    // Drop our device texture images
+    mImages.clear();
+
+    // Our base class deletes the texture it made for us
+    id = mEmptyTexId;
 }
 
 
@@ -67,63 +82,130 @@ bool VideoTex::refresh() {
         return false;
     }
 
-    // If we already have an image backing us, then it's time to return it
+    // If we already have an image backing us, then it's time to return it.  Its GL image is kept
+    // for when the camera gives us the same buffer again.
     if (mImageBuffer.memHandle.getNativeHandle() != nullptr) {
-        // Drop our device texture image
-        if (mKHRimage != EGL_NO_IMAGE_KHR) {
-            eglDestroyImageKHR(mDisplay, mKHRimage);
-            mKHRimage = EGL_NO_IMAGE_KHR;
-        }
-
-        // Return it since we're done with it
         mStreamHandler->doneWithFrame(mImageBuffer);
     }
 
     // Get the new image we want to use as our contents
     mImageBuffer = mStreamHandler->getNewFrame();
 
+    // Once our stream has been restarted, or our frame allowance changed, the camera may send
+    // new buffers under the IDs of the ones we have images of
+    const unsigned generation = mStreamHandler->getBufferGeneration();
+    if (generation != mBufferGeneration) {
+        mBufferGeneration = generation;
+        mImages.clear();
+    }
+
+    // The same goes for when the stream behind our camera is restarted without our asking
+    const auto now = std::chrono::steady_clock::now();
+    if (now - mLastRestartCheck >= kRestartCheckInterval) {
+        mLastRestartCheck = now;
+        const int32_t restarts = mCamera->getExtendedInfo(EXTENDED_INFO_STREAM_RESTARTS);
+        if (restarts != mStreamRestarts) {
+            mStreamRestarts = restarts;
+            mImages.clear();
+        }
+    }
+
+    // Usually the camera cycles through a few buffers we already have images for
+    CachedImage* cached = mImages.find(mImageBuffer);
+    if (cached == nullptr) {
+        cached = createImage(mImageBuffer);
+        if (cached == nullptr) {
+            // Returning "true" in this error condition because we already released the
+            // previous image (if any) and so the texture may change in unpredictable ways now!
+            id = mEmptyTexId;
+            return true;
+        }
+    }
+    id = cached->texId;
+
+    // Buffers the camera no longer seems to use (as when its buffer count is cut) are let go
+    mImages.releaseUnused(kMaxUnusedFrames);
 
+    return true;
+}
+
+
+// Gives back the frames we hold, as when nobody is drawing us for a while.  Otherwise they'd
+// use up our share of the camera's buffers, and have the frames after them dropped, leaving us
+// a stale one to show when we're next drawn.  We show nothing until the next refresh().
+void VideoTex::releaseFrames() {
+    if (mImageBuffer.memHandle.getNativeHandle() != nullptr) {
+        mStreamHandler->doneWithFrame(mImageBuffer);
+        mImageBuffer = {};
+    }
+    mStreamHandler->discardNewFrame();
+    id = mEmptyTexId;
+}
+
+
+VideoTex::CachedImage* VideoTex::createImage(const BufferDesc& buffer) {
     // create a GraphicBuffer from the existing handle
-    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(mImageBuffer.memHandle,
+    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(buffer.memHandle,
                                                      GraphicBuffer::CLONE_HANDLE,
-                                                     mImageBuffer.width, mImageBuffer.height,
-                                                     mImageBuffer.format, 1, // layer count
+                                                     buffer.width, buffer.height,
+                                                     buffer.format, 1, // layer count
                                                      GRALLOC_USAGE_HW_TEXTURE,
-                                                     mImageBuffer.stride);
+                                                     buffer.stride);
     if (pGfxBuffer.get() == nullptr) {
         ALOGE("Failed to allocate GraphicBuffer to wrap image handle");
-        // Returning "true" in this error condition because we already released the
-        // previous image (if any) and so the texture may change in unpredictable ways now!
-        return true;
+        return nullptr;
     }
 
     // Get a GL compatible reference to the graphics buffer we've been given
     EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
     EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-    mKHRimage = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
-                                  EGL_NATIVE_BUFFER_ANDROID, clientBuf,
-                                  eglImageAttributes);
-    if (mKHRimage == EGL_NO_IMAGE_KHR) {
+    EGLImageKHR image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
+                                          EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                          eglImageAttributes);
+    if (image == EGL_NO_IMAGE_KHR) {
         const char *msg = getEGLError();
         ALOGE("error creating EGLImage: %s", msg);
-    } else {
-        // Update the texture handle we already created to refer to this gralloc buffer
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, glId());
-        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(mKHRimage));
-
-        // Initialize the sampling properties (it seems the sample may not work if this isn't done)
-        // The user of this texture may very well want to set their own filtering, but we're going
-        // to pay the (minor) price of setting this up for them to avoid the dreaded "black image"
-        // if they forget.
-        // TODO:  Can we do this once for the texture ID rather than ever refresh?
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return nullptr;
     }
 
-    return true;
+    // Each buffer gets a texture of its own, so showing it again later is just a matter of
+    // binding that texture
+    GLuint texId = 0;
+    glGenTextures(1, &texId);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(image));
+
+    // Initialize the sampling properties (it seems the sample may not work if this isn't done)
+    // The user of this texture may very well want to set their own filtering, but we're going
+    // to pay the (minor) price of setting this up for them to avoid the dreaded "black image"
+    // if they forget.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    CachedImage cached;
+    cached.gfxBuffer = pGfxBuffer;
+    cached.image = image;
+    cached.texId = texId;
+    return mImages.add(buffer, cached);
+}
+
+
+void VideoTex::releaseImage(CachedImage* cached) {
+    if (cached->texId == id) {
+        id = mEmptyTexId;
+    }
+    if (cached->texId != 0) {
+        glDeleteTextures(1, &cached->texId);
+        cached->texId = 0;
+    }
+    if (cached->image != EGL_NO_IMAGE_KHR) {
+        eglDestroyImageKHR(mDisplay, cached->image);
+        cached->image = EGL_NO_IMAGE_KHR;
+    }
+    cached->gfxBuffer = nullptr;
 }
 
 
@@ -153,3 +235,76 @@ VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
 
     return new VideoTex(pEnum, pCamera, pStreamHandler, glDisplay);
 }
+
+
+namespace {
+struct CachedVideoTex {
+    std::shared_ptr<VideoTex>               tex;
+    bool                                    idle = false;
+    std::chrono::steady_clock::time_point   idleSince;
+};
+}
+
+// Our textures by camera ID.  Never destroyed, so the cameras aren't closed from under a
+// rendering thread still running as the process exits.
+static std::map<std::string, CachedVideoTex>& videoTexCache() {
+    static auto* sCache = new std::map<std::string, CachedVideoTex>();
+    return *sCache;
+}
+
+
+std::shared_ptr<VideoTex> acquireVideoTexture(sp<IEvsEnumerator> pEnum,
+                                              const char* evsCameraId,
+                                              EGLDisplay glDisplay) {
+    auto& cache = videoTexCache();
+
+    auto it = cache.find(evsCameraId);
+    if (it != cache.end()) {
+        if (it->second.tex->isStreaming()) {
+            it->second.idle = false;
+            it->second.tex->setFrameNotifications(true);
+            return it->second.tex;
+        }
+
+        // The stream ended while we weren't looking, so start afresh
+        cache.erase(it);
+    }
+
+    std::shared_ptr<VideoTex> tex(createVideoTexture(pEnum, evsCameraId, glDisplay));
+    if (tex) {
+        cache[evsCameraId].tex = tex;
+    }
+    return tex;
+}
+
+
+void releaseIdleVideoTextures(std::chrono::steady_clock::duration idleTime) {
+    const auto now = std::chrono::steady_clock::now();
+    auto& cache = videoTexCache();
+
+    for (auto it = cache.begin(); it != cache.end(); ) {
+        CachedVideoTex& entry = it->second;
+
+        // Anyone but us holding the texture is using it
+        if (entry.tex.use_count() > 1) {
+            entry.idle = false;
+            ++it;
+            continue;
+        }
+
+        if (!entry.idle) {
+            // Keep the stream going, but its frames no longer need drawing
+            entry.idle = true;
+            entry.idleSince = now;
+            entry.tex->setFrameNotifications(false);
+            entry.tex->releaseFrames();
+        }
+
+        if (now - entry.idleSince >= idleTime) {
+            ALOGD("Closing idle camera %s", it->first.c_str());
+            it = cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
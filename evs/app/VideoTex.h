@@ -25,6 +25,13 @@
 
 #include <android/hardware/automotive/evs/1.0/IEvsEnumerator.h>
 
+#include <ui/GraphicBuffer.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+
+#include "BufferCache.h"
 #include "TexWrapper.h"
 #include "StreamHandler.h"
 
@@ -42,6 +49,12 @@ public:
     virtual ~VideoTex();
 
     bool refresh();     // returns true if the texture contents were updated
+    bool hasNewFrame()  { return mStreamHandler->newFrameAvailable(); };
+    bool isStreaming()  { return mStreamHandler->isRunning(); };
+    void setFrameNotifications(bool enabled)    { mStreamHandler->setFrameNotifications(enabled); };
+    void releaseFrames();
+
+    sp<IEvsCamera> getCamera()  { return mCamera; };
 
 private:
     VideoTex(sp<IEvsEnumerator> pEnum,
@@ -49,13 +62,30 @@ private:
              sp<StreamHandler> pStreamHandler,
              EGLDisplay glDisplay);
 
+    // A GL texture bound to one of the camera's buffers
+    struct CachedImage {
+        android::sp<android::GraphicBuffer> gfxBuffer;
+        EGLImageKHR                     image = EGL_NO_IMAGE_KHR;
+        GLuint                          texId = 0;
+    };
+
+    CachedImage* createImage(const BufferDesc& buffer);
+    void releaseImage(CachedImage* cached);
+
     sp<IEvsEnumerator>  mEnumerator;
     sp<IEvsCamera>      mCamera;
     sp<StreamHandler>   mStreamHandler;
     BufferDesc          mImageBuffer;
 
     EGLDisplay          mDisplay;
-    EGLImageKHR mKHRimage = EGL_NO_IMAGE_KHR;
+
+    // Our images of the camera's buffers.  glId() gives the texture of the one holding the
+    // current frame.
+    BufferCache<CachedImage> mImages;
+    GLuint              mEmptyTexId = 0;
+    unsigned            mBufferGeneration = 0;  // See StreamHandler::getBufferGeneration()
+    int32_t             mStreamRestarts = 0;
+    std::chrono::steady_clock::time_point mLastRestartCheck;
 };
 
 
@@ -63,4 +93,16 @@ VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
                              const char * deviceName,
                              EGLDisplay glDisplay);
 
+// Returns a streaming texture for the given camera, shared with anyone else using that camera.
+// Textures stay open and streaming for a while after their last user lets go, so that moving
+// between views which show the same cameras doesn't restart their streams.  Only to be used
+// from the rendering thread.
+std::shared_ptr<VideoTex> acquireVideoTexture(sp<IEvsEnumerator> pEnum,
+                                              const char * deviceName,
+                                              EGLDisplay glDisplay);
+
+// Closes the cameras of textures nobody has used for the given time.  Call regularly from the
+// rendering thread.
+void releaseIdleVideoTextures(std::chrono::steady_clock::duration idleTime);
+
 #endif // VIDEOTEX_H
\ No newline at end of file
@@ -15,6 +15,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <hidl/HidlTransportSupport.h>
 #include <utils/Errors.h>
@@ -74,6 +75,7 @@ int main(int argc, char** argv)
     bool useVehicleHal = true;
     bool printHelp = false;
     const char* evsServiceName = "default";
+    unsigned maxFrameRate = 0;
     for (int i=1; i< argc; i++) {
         if (strcmp(argv[i], "--test") == 0) {
             useVehicleHal = false;
@@ -81,6 +83,8 @@ int main(int argc, char** argv)
             evsServiceName = "EvsEnumeratorHw";
         } else if (strcmp(argv[i], "--mock") == 0) {
             evsServiceName = "EvsEnumeratorHw-Mock";
+        } else if (strcmp(argv[i], "--fps") == 0 && i+1 < argc) {
+            maxFrameRate = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--help") == 0) {
             printHelp = true;
         } else {
@@ -93,6 +97,7 @@ int main(int argc, char** argv)
         printf("  --test   Do not talk to Vehicle Hal, but simulate 'reverse' instead\n");
         printf("  --hw     Bypass EvsManager by connecting directly to EvsEnumeratorHw\n");
         printf("  --mock   Connect directly to EvsEnumeratorHw-Mock\n");
+        printf("  --fps <n>  Draw no more than n frames per second (default follows the cameras)\n");
     }
 
     // Load our configuration information
@@ -154,6 +159,7 @@ int main(int argc, char** argv)
     // Configure ourselves for the current vehicle state at startup
     ALOGI("Constructing state controller");
     EvsStateControl *pStateController = new EvsStateControl(pVnet, pEvs, pDisplay, config);
+    pStateController->setMaxFrameRate(maxFrameRate);
     if (!pStateController->startUpdateLoop()) {
         ALOGE("Initial configuration failed.  Exiting.");
         return 1;
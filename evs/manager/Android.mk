@@ -8,6 +8,8 @@ LOCAL_SRC_FILES := \
     Enumerator.cpp \
     HalCamera.cpp \
     VirtualCamera.cpp \
+    SyncGroup.cpp \
+    ConvertedFramePool.cpp \
 
 
 LOCAL_SHARED_LIBRARIES := \
@@ -20,6 +22,9 @@ LOCAL_SHARED_LIBRARIES := \
     libhardware \
     android.hardware.automotive.evs@1.0 \
 
+LOCAL_STATIC_LIBRARIES := \
+    libevssupport \
+
 
 ifeq ($(NEXELL_QUICKBOOT), false)
 LOCAL_INIT_RC := android.automotive.evs.manager@1.0.rc
@@ -35,3 +40,22 @@ LOCAL_CFLAGS += -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES
 LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
 
 include $(BUILD_EXECUTABLE)
+
+
+##################################
+# Per-frame cost of our frame bookkeeping with several clients
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    FrameTable_benchmark.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    libhidlbase \
+    android.hardware.automotive.evs@1.0 \
+
+LOCAL_MODULE := evs_manager_frame_table_benchmark
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_NATIVE_BENCHMARK)
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConvertedFramePool.h"
+#include "BufferSync.h"
+#include "FormatConvert.h"
+
+#include <ui/GraphicBufferAllocator.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include <linux/dma-buf.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+using ::android::automotive::evs::support::copyNV21toRGB32;
+using ::android::automotive::evs::support::copyYV12toRGB32;
+using ::android::automotive::evs::support::copyYUYVtoRGB32;
+using ::android::automotive::evs::support::syncCpuWrite;
+
+
+// Enough for a frame being converted while clients hold a few others.  Past this, clients
+// asking for a converted format miss frames rather than have us use ever more memory.
+static const unsigned kMaxBuffers = 8;
+
+static const uint32_t kUsage = GRALLOC_USAGE_HW_TEXTURE     |
+                               GRALLOC_USAGE_SW_READ_RARELY |
+                               GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+
+ConvertedFramePool::~ConvertedFramePool() {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto&& slot : mSlots) {
+        if (slot.refs > 0) {
+            ALOGW("Freeing converted buffer %u still held by a client", slot.desc.bufferId);
+        }
+        freeSlot_Locked(&slot);
+    }
+}
+
+
+bool ConvertedFramePool::isSupportedFormat(int32_t format) {
+    return format == HAL_PIXEL_FORMAT_RGBA_8888;
+}
+
+
+bool ConvertedFramePool::canConvert(uint32_t sourceFormat, int32_t format) {
+    if (format != HAL_PIXEL_FORMAT_RGBA_8888) {
+        return false;
+    }
+    switch (sourceFormat) {
+    case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+    case HAL_PIXEL_FORMAT_YV12:
+    case HAL_PIXEL_FORMAT_YCBCR_422_I:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+bool ConvertedFramePool::convert(const BufferDesc& source, int32_t format,
+                                 BufferDesc* converted) {
+    unsigned idx = 0;
+    uint32_t* tgtPixels = nullptr;
+    buffer_handle_t tgtHandle = nullptr;
+    std::shared_ptr<const ColorConverter> converter;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!acquireSlot_Locked(source, format, &idx)) {
+            return false;
+        }
+
+        // The slot is ours alone until we hand out its description, so we can fill it in
+        // without the lock
+        mSlots[idx].refs = 1;
+        *converted = mSlots[idx].desc;
+        tgtPixels = mSlots[idx].pixels;
+        tgtHandle = mSlots[idx].handle;
+        converter = mConverter;
+    }
+
+    // Map the source frame for reading
+    sp<GraphicBuffer> src = new GraphicBuffer(source.memHandle, GraphicBuffer::CLONE_HANDLE,
+                                              source.width, source.height, source.format, 1,
+                                              source.usage, source.stride);
+    uint8_t* srcPixels = nullptr;
+    src->lock(GRALLOC_USAGE_SW_READ_OFTEN, (void**)&srcPixels);
+    if (!srcPixels) {
+        ALOGE("Failed to map frame %u for conversion", source.bufferId);
+        release(*converted);
+        return false;
+    }
+
+    // Our buffer stays mapped, so gralloc won't flush what we write for the GPU to see
+    syncCpuWrite(tgtHandle, DMA_BUF_SYNC_START);
+    switch (source.format) {
+    case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+        copyNV21toRGB32(source.width, source.height, srcPixels,
+                        tgtPixels, converted->stride, *converter);
+        break;
+    case HAL_PIXEL_FORMAT_YV12:
+        copyYV12toRGB32(source.width, source.height, srcPixels,
+                        tgtPixels, converted->stride, *converter);
+        break;
+    case HAL_PIXEL_FORMAT_YCBCR_422_I:
+        copyYUYVtoRGB32(source.width, source.height, srcPixels, source.stride,
+                        tgtPixels, converted->stride, *converter);
+        break;
+    }
+    syncCpuWrite(tgtHandle, DMA_BUF_SYNC_END);
+
+    src->unlock();
+    return true;
+}
+
+
+void ConvertedFramePool::addRef(const BufferDesc& buffer) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mSlots[buffer.bufferId - kFirstBufferId].refs++;
+}
+
+
+bool ConvertedFramePool::release(const BufferDesc& buffer) {
+    if (buffer.bufferId < kFirstBufferId) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    const unsigned idx = buffer.bufferId - kFirstBufferId;
+    if (idx >= mSlots.size() || mSlots[idx].refs == 0) {
+        return false;
+    }
+
+    // Once nobody holds the buffer, it's free for the next frame
+    mSlots[idx].refs--;
+    return true;
+}
+
+
+void ConvertedFramePool::configure(ColorMatrix matrix, ColorRange range) {
+    std::shared_ptr<const ColorConverter> converter =
+            std::make_shared<ColorConverter>(matrix, range);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mConverter = converter;
+}
+
+
+void ConvertedFramePool::trim() {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto&& slot : mSlots) {
+        if (slot.refs == 0) {
+            freeSlot_Locked(&slot);
+        }
+    }
+}
+
+
+// Finds an idle buffer suited to the frame, allocating one if need be
+bool ConvertedFramePool::acquireSlot_Locked(const BufferDesc& source, int32_t format,
+                                            unsigned* idx) {
+    // An idle buffer of the right kind is the first choice
+    for (unsigned i = 0; i < mSlots.size(); i++) {
+        const Slot& slot = mSlots[i];
+        if (slot.handle != nullptr && slot.refs == 0 &&
+            slot.desc.format == static_cast<uint32_t>(format) &&
+            slot.desc.width  == source.width &&
+            slot.desc.height == source.height) {
+            *idx = i;
+            return true;
+        }
+    }
+
+    // Otherwise we need a new one, in an empty slot if there is one, or in place of an idle
+    // buffer left over from a stream of a different size
+    Slot* empty = nullptr;
+    for (auto&& slot : mSlots) {
+        if (slot.handle == nullptr) {
+            empty = &slot;
+            break;
+        }
+    }
+    if (empty == nullptr && mSlots.size() < kMaxBuffers) {
+        mSlots.emplace_back();
+        empty = &mSlots.back();
+    }
+    if (empty == nullptr) {
+        for (auto&& slot : mSlots) {
+            if (slot.refs == 0) {
+                freeSlot_Locked(&slot);
+                empty = &slot;
+                break;
+            }
+        }
+    }
+    if (empty == nullptr) {
+        return false;
+    }
+    *idx = empty - mSlots.data();
+
+    buffer_handle_t handle = nullptr;
+    unsigned pixelsPerLine = 0;
+    status_t result = GraphicBufferAllocator::get().allocate(source.width, source.height,
+                                                             format, 1,
+                                                             kUsage,
+                                                             &handle, &pixelsPerLine, 0,
+                                                             "EvsManager");
+    if (result != NO_ERROR || !handle) {
+        ALOGE("Error %d allocating %u x %u buffer for format conversion",
+              result, source.width, source.height);
+        return false;
+    }
+
+    // The buffer stays mapped for its whole life, so converting into it costs no map per frame
+    uint32_t* pixels = nullptr;
+    GraphicBufferMapper::get().lock(handle,
+                                    GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                                    android::Rect(source.width, source.height),
+                                    (void **) &pixels);
+    if (!pixels) {
+        ALOGE("Failed to map buffer for format conversion");
+        GraphicBufferAllocator::get().free(handle);
+        return false;
+    }
+
+    empty->handle = handle;
+    empty->pixels = pixels;
+    empty->desc = {};
+    empty->desc.width     = source.width;
+    empty->desc.height    = source.height;
+    empty->desc.stride    = pixelsPerLine;
+    empty->desc.pixelSize = sizeof(uint32_t);
+    empty->desc.format    = format;
+    empty->desc.usage     = kUsage;
+    empty->desc.bufferId  = kFirstBufferId + *idx;
+    empty->desc.memHandle = handle;
+    return true;
+}
+
+
+void ConvertedFramePool::freeSlot_Locked(Slot* slot) {
+    if (slot->handle == nullptr) {
+        return;
+    }
+
+    if (slot->pixels != nullptr) {
+        GraphicBufferMapper::get().unlock(slot->handle);
+        slot->pixels = nullptr;
+    }
+    GraphicBufferAllocator::get().free(slot->handle);
+    slot->handle = nullptr;
+    slot->desc = {};
+    slot->refs = 0;
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_CONVERTEDFRAMEPOOL_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_CONVERTEDFRAMEPOOL_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <ui/GraphicBuffer.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ColorConvert.h"
+
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+using ::android::automotive::evs::support::ColorConverter;
+using ::android::automotive::evs::support::ColorMatrix;
+using ::android::automotive::evs::support::ColorRange;
+
+
+// Copies of a hardware camera's frames in the formats its clients asked for in place of the
+// camera's own (see EXTENDED_INFO_CLIENT_FORMAT).  A frame is converted at most once per format,
+// into a buffer which is shared by every client taking that format.  The buffers are reference
+// counted and go back into the pool for reuse once all those clients have returned them.
+class ConvertedFramePool {
+public:
+    // Our buffers are numbered from here up so they can't be mistaken for the hardware's own
+    enum : uint32_t { kFirstBufferId = 0x80000000 };
+
+    ~ConvertedFramePool();
+
+    // Whether clients may ask for this format, and whether we can produce it from this one
+    static bool isSupportedFormat(int32_t format);
+    static bool canConvert(uint32_t sourceFormat, int32_t format);
+
+    // Converts the frame into a buffer of the given format holding one reference.  Returns false
+    // if there's no buffer to be had.
+    bool convert(const BufferDesc& source, int32_t format, BufferDesc* converted);
+
+    // Take and drop references to a converted buffer.  release() returns false if the buffer
+    // isn't one of ours.
+    void addRef(const BufferDesc& buffer);
+    bool release(const BufferDesc& buffer);
+
+    // Match the camera's own YUV to RGB conversion
+    void configure(ColorMatrix matrix, ColorRange range);
+
+    // Frees the buffers nobody is holding, such as when the stream stops
+    void trim();
+
+private:
+    struct Slot {
+        buffer_handle_t handle = nullptr;   // Null if the slot is empty
+        uint32_t*       pixels = nullptr;   // Mapped for as long as the buffer lives
+        BufferDesc      desc = {};
+        unsigned        refs = 0;
+    };
+
+    bool acquireSlot_Locked(const BufferDesc& source, int32_t format, unsigned* idx);
+    void freeSlot_Locked(Slot* slot);
+
+    std::mutex                              mLock;
+    std::vector<Slot>                       mSlots;     // Indexed by bufferId - kFirstBufferId
+
+    // Replaced rather than changed, so a frame being converted right now isn't disturbed
+    std::shared_ptr<const ColorConverter>   mConverter = std::make_shared<ColorConverter>();
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_CONVERTEDFRAMEPOOL_H
@@ -27,6 +27,7 @@ bool Enumerator::init(const char* hardwareServiceName) {
     ALOGD("init");
 
     // Connect with the underlying hardware enumerator
+    mHwServiceName = hardwareServiceName;
     mHwEnumerator = IEvsEnumerator::getService(hardwareServiceName);
     bool result = (mHwEnumerator.get() != nullptr);
 
@@ -34,45 +35,81 @@ bool Enumerator::init(const char* hardwareServiceName) {
 }
 
 
+sp<IEvsCamera> Enumerator::reopenHwCamera(const std::string& cameraId) {
+    std::lock_guard<std::mutex> hwLock(mHwEnumeratorLock);
+
+    // If the camera died along with the rest of the hardware service, our connection to the
+    // hardware enumerator went too, so wait for the service to come back
+    if (!mHwEnumerator->ping().isOk()) {
+        ALOGW("Reconnecting to hardware service %s", mHwServiceName.c_str());
+        sp<IEvsEnumerator> hwEnumerator = IEvsEnumerator::getService(mHwServiceName);
+        if (hwEnumerator == nullptr) {
+            return nullptr;
+        }
+        mHwEnumerator = hwEnumerator;
+    }
+
+    Return<sp<IEvsCamera>> device = mHwEnumerator->openCamera(cameraId);
+    return device.isOk() ? sp<IEvsCamera>(device) : nullptr;
+}
+
+
+sp<IEvsEnumerator> Enumerator::getHwEnumerator() {
+    std::lock_guard<std::mutex> hwLock(mHwEnumeratorLock);
+    return mHwEnumerator;
+}
+
+
 // Methods from ::android::hardware::automotive::evs::V1_0::IEvsEnumerator follow.
 Return<void> Enumerator::getCameraList(getCameraList_cb list_cb)  {
     ALOGD("getCameraList");
 
-    // Simply pass through to hardware layer
-    return mHwEnumerator->getCameraList(list_cb);
+    // Ask the hardware layer the first time.  An empty answer isn't kept in case the hardware
+    // service simply hadn't found its cameras yet.
+    hidl_vec<CameraDesc> cameraList;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mCameraList.empty()) {
+            Return<void> result = getHwEnumerator()->getCameraList(
+                [this](const hidl_vec<CameraDesc>& hwCameraList) {
+                    mCameraList = hwCameraList;
+                }
+            );
+            if (!result.isOk()) {
+                ALOGE("Failed to get the camera list from the hardware service");
+                return result;
+            }
+        }
+        cameraList = mCameraList;
+    }
+
+    list_cb(cameraList);
+    return Void();
 }
 
 
 Return<sp<IEvsCamera>> Enumerator::openCamera(const hidl_string& cameraId) {
     ALOGD("openCamera");
+    std::lock_guard<std::mutex> lock(mLock);
 
     // Is the underlying hardware camera already open?
     sp<HalCamera> hwCamera;
-    for (auto &&cam : mCameras) {
-        bool match = false;
-        cam->getHwCamera()->getCameraInfo([cameraId, &match](CameraDesc desc) {
-                                      if (desc.cameraId == cameraId) {
-                                          match = true;
-                                      }
-                                  }
-        );
-        if (match) {
-            hwCamera = cam;
-            break;
-        }
+    auto it = mCameras.find(cameraId);
+    if (it != mCameras.end()) {
+        hwCamera = it->second;
     }
 
     // Do we need to open a new hardware camera?
     if (hwCamera == nullptr) {
         // Is the hardware camera available?
-        sp<IEvsCamera> device = mHwEnumerator->openCamera(cameraId);
+        sp<IEvsCamera> device = getHwEnumerator()->openCamera(cameraId);
         if (device == nullptr) {
             ALOGE("Failed to open hardware camera %s", cameraId.c_str());
         } else {
-            hwCamera = new HalCamera(device);
+            hwCamera = new HalCamera(device, cameraId, this);
             if (hwCamera == nullptr) {
                 ALOGE("Failed to allocate camera wrapper object");
-                mHwEnumerator->closeCamera(device);
+                getHwEnumerator()->closeCamera(device);
             }
         }
     }
@@ -83,9 +120,9 @@ Return<sp<IEvsCamera>> Enumerator::openCamera(const hidl_string& cameraId) {
         clientCamera = hwCamera->makeVirtualCamera();
     }
 
-    // Add the hardware camera to our list, which will keep it alive via ref count
+    // Add the hardware camera to our table, which will keep it alive via ref count
     if (clientCamera != nullptr) {
-        mCameras.push_back(hwCamera);
+        mCameras[cameraId] = hwCamera;
     } else {
         ALOGE("Requested camera %s not found or not available", cameraId.c_str());
     }
@@ -108,18 +145,23 @@ Return<void> Enumerator::closeCamera(const ::android::sp<IEvsCamera>& clientCame
 
     // Find the parent camera that backs this virtual camera
     sp<HalCamera> halCamera = virtualCamera->getHalCamera();
+    if (halCamera == nullptr) {
+        ALOGE("Ignoring call to close a camera which is already closed.");
+        return Void();
+    }
 
     // Tell the virtual camera's parent to clean it up and drop it
     // NOTE:  The camera objects will only actually destruct when the sp<> ref counts get to
     //        zero, so it is important to break all cyclic references.
+    std::lock_guard<std::mutex> lock(mLock);
     halCamera->disownVirtualCamera(virtualCamera);
 
     // Did we just remove the last client of this camera?
     if (halCamera->getClientCount() == 0) {
-        // Take this now unused camera out of our list
+        // Take this now unused camera out of our table
         // NOTE:  This should drop our last reference to the camera, resulting in its
         //        destruction.
-        mCameras.remove(halCamera);
+        mCameras.erase(halCamera->getId());
     }
 
     return Void();
@@ -135,13 +177,14 @@ Return<sp<IEvsDisplay>> Enumerator::openDisplay() {
     // create/destroy order and provides a cleaner restart sequence if the previous owner
     // is non-responsive for some reason.
     // Request exclusive access to the EVS display
-    sp<IEvsDisplay> pActiveDisplay = mHwEnumerator->openDisplay();
+    sp<IEvsDisplay> pActiveDisplay = getHwEnumerator()->openDisplay();
     if (pActiveDisplay == nullptr) {
         ALOGE("EVS Display unavailable");
     }
 
     // Remember (via weak pointer) who we think the most recently opened display is so that
     // we can proxy state requests from other callers to it.
+    std::lock_guard<std::mutex> lock(mLock);
     mActiveDisplay = pActiveDisplay;
     return pActiveDisplay;
 }
@@ -151,6 +194,7 @@ Return<void> Enumerator::closeDisplay(const ::android::sp<IEvsDisplay>& display)
     ALOGD("closeDisplay");
 
     // Do we still have a display object we think should be active?
+    std::lock_guard<std::mutex> lock(mLock);
     sp<IEvsDisplay> pActiveDisplay = mActiveDisplay.promote();
 
     // Drop the active display
@@ -159,7 +203,7 @@ Return<void> Enumerator::closeDisplay(const ::android::sp<IEvsDisplay>& display)
         ALOGI("Got %p while active display is %p.", display.get(), pActiveDisplay.get());
     } else {
         // Pass this request through to the hardware layer
-        mHwEnumerator->closeDisplay(display);
+        getHwEnumerator()->closeDisplay(display);
         mActiveDisplay = nullptr;
     }
 
@@ -171,15 +215,19 @@ Return<DisplayState> Enumerator::getDisplayState()  {
     ALOGD("getDisplayState");
 
     // Do we have a display object we think should be active?
-    sp<IEvsDisplay> pActiveDisplay = mActiveDisplay.promote();
-    if (pActiveDisplay != nullptr) {
-        // Pass this request through to the hardware layer
-        return pActiveDisplay->getDisplayState();
-    } else {
-        // We don't have a live display right now
-        mActiveDisplay = nullptr;
-        return DisplayState::NOT_OPEN;
+    sp<IEvsDisplay> pActiveDisplay;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        pActiveDisplay = mActiveDisplay.promote();
+        if (pActiveDisplay == nullptr) {
+            // We don't have a live display right now
+            mActiveDisplay = nullptr;
+            return DisplayState::NOT_OPEN;
+        }
     }
+
+    // Pass this request through to the hardware layer (without holding up other callers)
+    return pActiveDisplay->getDisplayState();
 }
 
 
@@ -17,7 +17,10 @@
 #ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_EVSCAMERAENUMERATOR_H
 #define ANDROID_AUTOMOTIVE_EVS_V1_0_EVSCAMERAENUMERATOR_H
 
-#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "HalCamera.h"
 #include "VirtualCamera.h"
@@ -28,6 +31,7 @@
 using namespace ::android::hardware::automotive::evs::V1_0;
 using ::android::hardware::Return;
 using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
 
 namespace android {
 namespace automotive {
@@ -48,10 +52,32 @@ public:
     // Implementation details
     bool init(const char* hardwareServiceName);
 
+    // Opens the hardware camera again for a HalCamera whose camera died, reconnecting to the
+    // hardware service if it went with it.  Takes none of the locks held while calling into a
+    // HalCamera.
+    sp<IEvsCamera> reopenHwCamera(const std::string& cameraId);
+
 private:
+    sp<IEvsEnumerator>          getHwEnumerator();
+
+    // Guards only mHwEnumerator, which is replaced if the hardware service restarts
+    std::mutex                  mHwEnumeratorLock;
     sp<IEvsEnumerator>          mHwEnumerator;  // Hardware enumerator
+    std::string                 mHwServiceName;
+
     wp<IEvsDisplay>             mActiveDisplay; // Hardware display
-    std::list<sp<HalCamera>>    mCameras;       // Camera proxy objects wrapping hw cameras
+
+    // Camera proxy objects wrapping the open hw cameras, by cameraId
+    std::unordered_map<std::string, sp<HalCamera>>  mCameras;
+
+    // The hardware's camera list, fetched on first use since it doesn't change while we run
+    std::vector<CameraDesc>     mCameraList;
+
+    // Guards everything above bar mHwEnumerator, since clients may call us from several binder
+    // threads at once.
+    // Held while opening and closing hardware cameras so two clients can't race to open the
+    // same one.
+    std::mutex                  mLock;
 };
 
 } // namespace implementation
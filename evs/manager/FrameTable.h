@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMETABLE_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMETABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Per frame records looked up by bufferId in constant time.  Drivers normally number their
+// buffers from zero, so small IDs index straight into an array.  Anything larger (a driver is
+// free to choose its own IDs, and our converted frames start at 0x80000000) goes into a small
+// open addressed table instead, which stays as cheap as the array for the few dozen frames we
+// ever have in flight.
+template <typename T>
+class FrameTable {
+public:
+    // Returns null if there is no record for this ID
+    T* find(uint32_t id) {
+        if (id < kDenseLimit) {
+            return (id < mDense.size() && mDense[id].used) ? &mDense[id].value : nullptr;
+        }
+        if (mSparse.empty()) {
+            return nullptr;
+        }
+        Entry& entry = mSparse[findSlot(id)];
+        return entry.used ? &entry.value : nullptr;
+    }
+
+    // Adds a record for this ID, replacing any there already
+    T& insert(uint32_t id, const T& value) {
+        if (id < kDenseLimit) {
+            if (id >= mDense.size()) {
+                mDense.resize(id + 1);
+            }
+            if (!mDense[id].used) {
+                mDense[id].used = true;
+                mCount++;
+            }
+            mDense[id].value = value;
+            return mDense[id].value;
+        }
+
+        // Kept at most half full, so probe sequences stay short
+        if ((mSparseCount + 1) * 2 > mSparse.size()) {
+            growSparse();
+        }
+        Entry& entry = mSparse[findSlot(id)];
+        if (!entry.used) {
+            entry.used = true;
+            entry.id = id;
+            mSparseCount++;
+            mCount++;
+        }
+        entry.value = value;
+        return entry.value;
+    }
+
+    // Returns false if there was no record for this ID
+    bool erase(uint32_t id) {
+        if (id < kDenseLimit) {
+            if (id >= mDense.size() || !mDense[id].used) {
+                return false;
+            }
+            mDense[id].used = false;
+            mDense[id].value = T();
+            mCount--;
+            return true;
+        }
+        if (mSparse.empty()) {
+            return false;
+        }
+        size_t slot = findSlot(id);
+        if (!mSparse[slot].used) {
+            return false;
+        }
+        eraseSlot(slot);
+        mSparseCount--;
+        mCount--;
+        return true;
+    }
+
+    // Visits every record.  Only used on slow paths like shutdown.
+    template <typename F>
+    void forEach(F visit) {
+        for (uint32_t id = 0; id < mDense.size(); id++) {
+            if (mDense[id].used) {
+                visit(id, mDense[id].value);
+            }
+        }
+        for (auto&& entry : mSparse) {
+            if (entry.used) {
+                visit(entry.id, entry.value);
+            }
+        }
+    }
+
+    void clear() {
+        mDense.clear();
+        mSparse.clear();
+        mSparseCount = 0;
+        mCount = 0;
+    }
+
+    unsigned size() const   { return mCount; };
+
+private:
+    static constexpr uint32_t kDenseLimit = 1024;
+    static constexpr size_t   kMinSparseSize = 64;  // Must be a power of two
+
+    struct Entry {
+        bool        used = false;
+        uint32_t    id = 0;     // Only kept for the sparse table
+        T           value = T();
+    };
+
+    // Where the probe for this ID starts.  We take the top bits of a multiplicative hash, as
+    // they depend on every bit of the ID, so both consecutive IDs and IDs differing only in
+    // their high bits are spread out.
+    size_t homeSlot(uint32_t id) const {
+        return static_cast<uint32_t>(id * 2654435761u) >> mSparseShift;
+    }
+
+    // The slot holding this ID, or the empty one where it would go
+    size_t findSlot(uint32_t id) const {
+        const size_t mask = mSparse.size() - 1;
+        size_t slot = homeSlot(id);
+        while (mSparse[slot].used && mSparse[slot].id != id) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    // Empties a slot, moving back any entries further along its probe sequence so that no
+    // lookup stops short at the hole
+    void eraseSlot(size_t hole) {
+        const size_t mask = mSparse.size() - 1;
+        size_t next = hole;
+        for (;;) {
+            next = (next + 1) & mask;
+            if (!mSparse[next].used) {
+                break;
+            }
+
+            // An entry whose probe starts cyclically after the hole, up to where it sits, is
+            // still reachable and stays put
+            const size_t home = homeSlot(mSparse[next].id);
+            const bool reachable = (hole < next) ? (home > hole && home <= next)
+                                                 : (home > hole || home <= next);
+            if (!reachable) {
+                mSparse[hole] = mSparse[next];
+                hole = next;
+            }
+        }
+        mSparse[hole] = Entry();
+    }
+
+    void growSparse() {
+        std::vector<Entry> old;
+        old.swap(mSparse);
+        mSparse.resize(old.empty() ? kMinSparseSize : old.size() * 2);
+        mSparseShift = 32;
+        for (size_t size = mSparse.size(); size > 1; size >>= 1) {
+            mSparseShift--;
+        }
+        for (auto&& entry : old) {
+            if (entry.used) {
+                mSparse[findSlot(entry.id)] = entry;
+            }
+        }
+    }
+
+    std::vector<Entry>      mDense;
+    std::vector<Entry>      mSparse;        // Sized to a power of two, or empty
+    unsigned                mSparseShift = 32;  // Leaves log2(mSparse.size()) bits of hash
+    unsigned                mSparseCount = 0;
+    unsigned                mCount = 0;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMETABLE_H
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the frame bookkeeping HalCamera and VirtualCamera do for every frame: the hardware
+// delivers a buffer, each client takes a reference and holds it, and later hands it back.  We
+// keep 8 clients and 32 buffers in flight, with FrameTable and with the linear searches it
+// replaced.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+
+#include "FrameTable.h"
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+using ::android::automotive::evs::V1_0::implementation::FrameTable;
+
+
+static const unsigned kClients = 8;
+static const unsigned kBuffersInFlight = 32;
+
+
+// What HalCamera and each VirtualCamera keep, as they keep it now
+struct TableCamera {
+    std::mutex                  frameLock;
+    FrameTable<uint32_t>        frames;     // References held, by bufferId
+    std::mutex                  clientLock[kClients];
+    FrameTable<BufferDesc>      held[kClients];
+
+    void deliver(const BufferDesc& buffer) {
+        {
+            std::lock_guard<std::mutex> lock(frameLock);
+            frames.insert(buffer.bufferId, 1);
+        }
+        for (unsigned c = 0; c < kClients; c++) {
+            {
+                std::lock_guard<std::mutex> lock(frameLock);
+                uint32_t* refCount = frames.find(buffer.bufferId);
+                if (refCount != nullptr) {
+                    (*refCount)++;
+                }
+            }
+            std::lock_guard<std::mutex> lock(clientLock[c]);
+            held[c].insert(buffer.bufferId, buffer);
+        }
+        release(buffer.bufferId);   // Our own reference
+    }
+
+    void done(unsigned client, uint32_t bufferId) {
+        {
+            std::lock_guard<std::mutex> lock(clientLock[client]);
+            if (!held[client].erase(bufferId)) {
+                return;
+            }
+        }
+        release(bufferId);
+    }
+
+    void release(uint32_t bufferId) {
+        std::lock_guard<std::mutex> lock(frameLock);
+        uint32_t* refCount = frames.find(bufferId);
+        if (refCount != nullptr && --(*refCount) == 0) {
+            frames.erase(bufferId);
+        }
+    }
+};
+
+
+// The same, kept the way it was before FrameTable
+struct ListCamera {
+    struct FrameRecord {
+        uint32_t    frameId;
+        uint32_t    refCount;
+    };
+
+    std::mutex                  frameLock;
+    std::vector<FrameRecord>    frames;
+    std::mutex                  clientLock[kClients];
+    std::deque<BufferDesc>      held[kClients];
+
+    void deliver(const BufferDesc& buffer) {
+        {
+            std::lock_guard<std::mutex> lock(frameLock);
+            auto it = std::find_if(frames.begin(), frames.end(),
+                                   [](const FrameRecord& rec) { return rec.refCount == 0; });
+            if (it == frames.end()) {
+                frames.push_back({buffer.bufferId, 1});
+            } else {
+                *it = {buffer.bufferId, 1};
+            }
+        }
+        for (unsigned c = 0; c < kClients; c++) {
+            {
+                std::lock_guard<std::mutex> lock(frameLock);
+                for (auto&& rec : frames) {
+                    if (rec.frameId == buffer.bufferId && rec.refCount > 0) {
+                        rec.refCount++;
+                        break;
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> lock(clientLock[c]);
+            held[c].push_back(buffer);
+        }
+        release(buffer.bufferId);
+    }
+
+    void done(unsigned client, uint32_t bufferId) {
+        {
+            std::lock_guard<std::mutex> lock(clientLock[client]);
+            auto it = std::find_if(held[client].begin(), held[client].end(),
+                                   [bufferId](const BufferDesc& b) {
+                                       return b.bufferId == bufferId;
+                                   });
+            if (it == held[client].end()) {
+                return;
+            }
+            held[client].erase(it);
+        }
+        release(bufferId);
+    }
+
+    void release(uint32_t bufferId) {
+        std::lock_guard<std::mutex> lock(frameLock);
+        for (auto&& rec : frames) {
+            if (rec.frameId == bufferId && rec.refCount > 0) {
+                rec.refCount--;
+                break;
+            }
+        }
+    }
+};
+
+
+// Cycles through the buffers, each client handing back the oldest frame it holds (in turn,
+// as clients rarely finish with a frame at the same moment) just before it's delivered again
+template <typename Camera>
+static void runFrames(benchmark::State& state) {
+    const uint32_t firstId = state.range(0);
+    Camera camera;
+
+    std::vector<BufferDesc> buffers(kBuffersInFlight);
+    for (unsigned i = 0; i < kBuffersInFlight; i++) {
+        buffers[i] = {};
+        buffers[i].bufferId = firstId + i;
+    }
+    for (auto&& buffer : buffers) {
+        camera.deliver(buffer);
+    }
+
+    unsigned next = 0;
+    while (state.KeepRunning()) {
+        const BufferDesc& buffer = buffers[next];
+        for (unsigned c = 0; c < kClients; c++) {
+            camera.done((c + next) % kClients, buffer.bufferId);
+        }
+        camera.deliver(buffer);
+        next = (next + 1) % kBuffersInFlight;
+    }
+}
+
+
+// Drivers usually number their buffers from zero; others choose IDs of their own.  Frames we
+// convert for our clients are numbered from ConvertedFramePool::kFirstBufferId.
+BENCHMARK_TEMPLATE(runFrames, TableCamera)->Arg(0)->Arg(0x10000)->Arg(0x80000000);
+BENCHMARK_TEMPLATE(runFrames, ListCamera)->Arg(0)->Arg(0x10000)->Arg(0x80000000);
+
+
+BENCHMARK_MAIN();
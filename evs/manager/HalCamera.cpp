@@ -18,9 +18,13 @@
 #include "VirtualCamera.h"
 #include "Enumerator.h"
 
+#include "EvsExtendedInfo.h"
+
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 
+#include <algorithm>
+
 
 namespace android {
 namespace automotive {
@@ -29,7 +33,61 @@ namespace V1_0 {
 namespace implementation {
 
 
-// TODO:  We need to hook up death monitoring to detect stream death so we can attempt a reconnect
+using ::android::automotive::evs::support::EXTENDED_INFO_COLOR_MATRIX;
+using ::android::automotive::evs::support::EXTENDED_INFO_COLOR_RANGE;
+
+
+// Zero means no watchdog
+static std::chrono::milliseconds sWatchdogDeadline(0);
+
+// The hardware's buffer count grows in steps of this many buffers
+static const unsigned kBufferChunk = 2;
+
+// How long our clients must have needed fewer buffers before we give the spares back.  Long
+// enough to ride out a quick trip through reverse.
+static const std::chrono::seconds kShrinkDelay(5);
+
+
+void HalCamera::setWatchdogDeadline(std::chrono::milliseconds deadline) {
+    sWatchdogDeadline = deadline;
+}
+
+
+// Done here rather than in the constructor, since the death monitor needs a weak pointer to us
+void HalCamera::onFirstRef() {
+    mDeathMonitor = new DeathMonitor(this);
+    Return<bool> linked = getHwCamera()->linkToDeath(mDeathMonitor, 0);
+    if (!linked.isOk() || !linked) {
+        ALOGW("Can't watch for the death of camera %s", mCameraId.c_str());
+    }
+
+    mWatchdogThread = std::thread(watchdogLoop, wp<HalCamera>(this), mWatchdog);
+}
+
+
+HalCamera::~HalCamera() {
+    {
+        std::lock_guard<std::mutex> lock(mWatchdog->lock);
+        mWatchdog->exit = true;
+    }
+    mWatchdog->signal.notify_all();
+
+    // Our last reference could be dropped by the watchdog itself, through a client it ended.  It
+    // touches nothing of ours after that, so can be left to finish on its own.
+    if (mWatchdogThread.get_id() == std::this_thread::get_id()) {
+        mWatchdogThread.detach();
+    } else if (mWatchdogThread.joinable()) {
+        mWatchdogThread.join();
+    }
+
+    getHwCamera()->unlinkToDeath(mDeathMonitor);
+}
+
+
+sp<IEvsCamera> HalCamera::getHwCamera() {
+    std::lock_guard<std::mutex> hwLock(mHwLock);
+    return mHwCamera;
+}
 
 
 sp<VirtualCamera> HalCamera::makeVirtualCamera() {
@@ -42,15 +100,21 @@ sp<VirtualCamera> HalCamera::makeVirtualCamera() {
     }
 
     // Make sure we have enough buffers available for all our clients
-    if (!changeFramesInFlight(client->getAllowedBuffers())) {
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
+    if (!changeFramesInFlight_Locked(client->getAllowedBuffers())) {
         // Gah!  We couldn't get enough buffers, so we can't support this client
-        // Null the pointer, dropping our reference, thus destroying the client object
+        // Null the pointer, dropping our reference, thus destroying the client object.  It gives
+        // back its allowance as it goes, so count it in first to keep our total straight.
+        mBuffersNeeded += client->getAllowedBuffers();
         client = nullptr;
         return nullptr;
     }
 
     // Add this client to our ownership list via weak pointer
-    mClients.push_back(client);
+    {
+        std::lock_guard<std::mutex> clientLock(mClientLock);
+        mClients.push_back(client);
+    }
 
     // Return the strong pointer to the client
     return client;
@@ -68,69 +132,128 @@ void HalCamera::disownVirtualCamera(sp<VirtualCamera> virtualCamera) {
     virtualCamera->stopVideoStream();
 
     // Remove the virtual camera from our client list
-    unsigned clientCount = mClients.size();
-    mClients.remove(virtualCamera);
-    if (clientCount != mClients.size() + 1) {
-        ALOGE("Couldn't find camera in our client list to remove it");
+    {
+        std::lock_guard<std::mutex> clientLock(mClientLock);
+        unsigned clientCount = mClients.size();
+        mClients.remove(virtualCamera);
+        if (clientCount != mClients.size() + 1) {
+            ALOGE("Couldn't find camera in our client list to remove it");
+        }
     }
+
+    // This gives back the client's buffer allowance too
     virtualCamera->shutdown();
+}
 
-    // Recompute the number of buffers required with the target camera removed from the list
-    if (!changeFramesInFlight(0)) {
-        ALOGE("Error when trying to reduce the in flight buffer count");
-    }
+
+unsigned HalCamera::getClientCount() {
+    std::lock_guard<std::mutex> clientLock(mClientLock);
+    return mClients.size();
 }
 
 
 bool HalCamera::changeFramesInFlight(int delta) {
-    // Walk all our clients and count their currently required frames
-    unsigned bufferCount = 0;
-    for (auto&& client :  mClients) {
-        sp<VirtualCamera> virtCam = client.promote();
-        if (virtCam != nullptr) {
-            bufferCount += virtCam->getAllowedBuffers();
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
+    return changeFramesInFlight_Locked(delta);
+}
+
+
+// Changes our clients' total buffer allowance, asking the hardware for more buffers if they no
+// longer fit in what it has
+bool HalCamera::changeFramesInFlight_Locked(int delta) {
+    // Never drop below 1 buffer -- even if all client cameras get closed
+    const int needed = std::max<int>(static_cast<int>(mBuffersNeeded) + delta, 1);
+
+    if (static_cast<unsigned>(needed) > mBuffersGranted) {
+        // Round up to a whole chunk, so that the next client along probably fits too.  If the
+        // hardware can't manage the extra, settle for just what's needed.
+        const unsigned chunked = (needed + kBufferChunk - 1) / kBufferChunk * kBufferChunk;
+        if (!setHwBufferCount_Locked(chunked) &&
+            (chunked == static_cast<unsigned>(needed) || !setHwBufferCount_Locked(needed))) {
+            return false;
         }
+    } else if (static_cast<unsigned>(needed) < mBuffersGranted) {
+        scheduleShrink();
     }
 
-    // Add the requested delta
-    bufferCount += delta;
+    mBuffersNeeded += delta;
+    return true;
+}
 
-    // Never drop below 1 buffer -- even if all client cameras get closed
-    if (bufferCount < 1) {
-        bufferCount = 1;
+
+// Gives back a departing client's allowance.  The hardware keeps the buffers for now, in case
+// another client turns up soon.  Takes only the watchdog's lock, as our last reference to a
+// client can be dropped with mStreamLock held.
+void HalCamera::releaseClientBuffers(unsigned count) {
+    mBuffersNeeded -= count;
+    scheduleShrink();
+}
+
+
+bool HalCamera::setHwBufferCount_Locked(unsigned bufferCount) {
+    Return<EvsResult> result = getHwCamera()->setMaxFramesInFlight(bufferCount);
+    if (!result.isOk() || result != EvsResult::OK) {
+        return false;
     }
+    mBuffersGranted = bufferCount;
 
-    // Ask the hardware for the resulting buffer count
-    Return<EvsResult> result = mHwCamera->setMaxFramesInFlight(bufferCount);
-    bool success = (result.isOk() && result == EvsResult::OK);
+    // Outstanding frame records are indexed by bufferId, so there's nothing to resize
+    std::lock_guard<std::mutex> frameLock(mFrameLock);
+    if (mFrames.size() > bufferCount) {
+        ALOGW("We found more frames in use than requested.");
+    }
+    return true;
+}
 
-    // Update the size of our array of outstanding frame records
-    if (success) {
-        std::vector<FrameRecord> newRecords;
-        newRecords.reserve(bufferCount);
 
-        // Copy and compact the old records that are still active
-        for (const auto& rec : mFrames) {
-            if (rec.refCount > 0) {
-                newRecords.emplace_back(rec);
-            }
-        }
-        if (newRecords.size() > (unsigned)bufferCount) {
-            ALOGW("We found more frames in use than requested.");
-        }
+// Has the watchdog shrink the hardware's buffer count once our needs have been steady for a while
+void HalCamera::scheduleShrink() {
+    {
+        std::lock_guard<std::mutex> lock(mWatchdog->lock);
+        mWatchdog->shrinkPending = true;
+        mWatchdog->shrinkDue = std::chrono::steady_clock::now() + kShrinkDelay;
+        mWatchdog->wakeup = true;
+    }
+    mWatchdog->signal.notify_all();
+}
+
+
+void HalCamera::shrinkBuffers() {
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
 
-        mFrames.swap(newRecords);
+    const unsigned needed = std::max(mBuffersNeeded.load(), 1u);
+    const unsigned chunked = (needed + kBufferChunk - 1) / kBufferChunk * kBufferChunk;
+    if (chunked >= mBuffersGranted) {
+        return;
     }
 
-    return success;
+    // Clients still holding frames can keep the hardware from freeing them; if so we carry on
+    // with the buffers we have until the next change comes along
+    const unsigned oldCount = mBuffersGranted;
+    if (setHwBufferCount_Locked(chunked)) {
+        ALOGD("Camera %s buffer count trimmed from %u to %u", mCameraId.c_str(), oldCount, chunked);
+    } else {
+        ALOGW("Failed to trim camera %s buffer count to %u", mCameraId.c_str(), chunked);
+    }
 }
 
 
 Return<EvsResult> HalCamera::clientStreamStarting() {
     Return<EvsResult> result = EvsResult::OK;
 
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
     if (mStreamState == STOPPED) {
-        result = mHwCamera->startVideoStream(this);
+        // Our format conversions need to agree with the hardware's idea of the colors
+        updateColorSettings();
+        mStaleEndMarkers = 0;
+
+        result = getHwCamera()->startVideoStream(this);
+        if (result.isOk() && result == EvsResult::OK) {
+            // The watchdog counts from here until the first frame
+            markFrameArrival();
+            mStreamState = RUNNING;
+            wakeWatchdog();
+        }
     }
 
     return result;
@@ -138,53 +261,144 @@ Return<EvsResult> HalCamera::clientStreamStarting() {
 
 
 void HalCamera::clientStreamEnding() {
+    std::lock_guard<std::mutex> streamLock(mStreamLock);
+
     // Do we still have a running client?
     bool stillRunning = false;
-    for (auto&& client : mClients) {
-        sp<VirtualCamera> virtCam = client.promote();
-        if (virtCam != nullptr) {
-            stillRunning |= virtCam->isStreaming();
-        }
+    for (auto&& virtCam : getClients()) {
+        stillRunning |= virtCam->isStreaming();
     }
 
-    // If not, then stop the hardware stream
-    if (!stillRunning) {
-        mHwCamera->stopVideoStream();
+    // If not, then stop the hardware stream.  Its end of stream marker may come back to us on
+    // this thread before the call returns.
+    if (!stillRunning && mStreamState == RUNNING) {
+        mStreamState = STOPPING;
+        getHwCamera()->stopVideoStream();
+        mStreamState = STOPPED;
+
+        // Nobody needs the converted frame buffers until the next stream, which may be a
+        // different size anyway
+        mConvertedFrames.trim();
     }
 }
 
 
 Return<void> HalCamera::doneWithFrame(const BufferDesc& buffer) {
-    // Find this frame in our list of outstanding frames
-    unsigned i;
-    for (i=0; i<mFrames.size(); i++) {
-        if (mFrames[i].frameId == buffer.bufferId) {
-            break;
+    // Converted frames go back into our own pool rather than to the hardware
+    if (!mConvertedFrames.release(buffer)) {
+        releaseFrame(buffer);
+    }
+    return Void();
+}
+
+
+void HalCamera::updateColorSettings() {
+    // Cameras which don't know about these settings report zero, which is BT.601 limited range
+    int32_t matrix = getHwCamera()->getExtendedInfo(EXTENDED_INFO_COLOR_MATRIX);
+    int32_t range  = getHwCamera()->getExtendedInfo(EXTENDED_INFO_COLOR_RANGE);
+    mConvertedFrames.configure(static_cast<ColorMatrix>(matrix), static_cast<ColorRange>(range));
+}
+
+
+Return<void> HalCamera::deliverFrame(const BufferDesc& buffer) {
+    std::vector<sp<VirtualCamera>> clients = getClients();
+
+    if (buffer.memHandle == nullptr) {
+        // The end of a stream we restarted, which our clients needn't see.  Drivers may send it
+        // after their stopVideoStream() returns, so it's counted rather than tied to our state.
+        unsigned staleEnds = mStaleEndMarkers;
+        while (staleEnds > 0) {
+            if (mStaleEndMarkers.compare_exchange_weak(staleEnds, staleEnds - 1)) {
+                return Void();
+            }
+        }
+        if (mStreamState == RUNNING) {
+            // The hardware ended the stream without being asked to, so start it up again.  Our
+            // clients only hear of it if that fails.
+            ALOGW("Camera %s stream ended unexpectedly", mCameraId.c_str());
+            requestRestart(false);
+            return Void();
         }
+
+        // Pass the end marker to each of our clients
+        const auto now = std::chrono::steady_clock::now();
+        for (auto&& virtCam : clients) {
+            virtCam->deliverFrame(buffer, now);
+        }
+        return Void();
     }
-    if (i == mFrames.size()) {
-        ALOGE("We got a frame back with an ID we don't recognize!");
-    } else {
-        // Are there still clients using this buffer?
-        mFrames[i].refCount--;
-        if (mFrames[i].refCount <= 0) {
-            // Since all our clients are done with this buffer, return it to the device layer
-            mHwCamera->doneWithFrame(buffer);
+
+    markFrameArrival();
+
+    // Hold our own reference to the frame while it's handed out so that a client returning it
+    // right away can't send it back to the hardware before the others have seen it
+    unsigned generation;
+    {
+        std::lock_guard<std::mutex> frameLock(mFrameLock);
+        if (mFrames.find(buffer.bufferId) != nullptr) {
+            // The hardware must not send a buffer again before we've given it back.  Our clients
+            // still hold the first delivery, which will go back once when they're done with it.
+            ALOGE("Camera %s delivered frame %u while it was still out, so ignoring it",
+                  mCameraId.c_str(), buffer.bufferId);
+            return Void();
         }
+        mFrames.insert(buffer.bufferId, 1);
+        generation = mFrameGeneration;
     }
 
-    return Void();
-}
+    // The 1.0 BufferDesc carries no capture time, so frames are matched up across cameras by
+    // when they got here.  Every client sees the same time for the same frame.
+    const auto arrivalTime = std::chrono::steady_clock::now();
+
+    // Our converted frames are told apart from the hardware's by their IDs
+    bool conversionAllowed = true;
+    if (buffer.bufferId >= ConvertedFramePool::kFirstBufferId) {
+        if (!mWarnedAboutBufferIds) {
+            ALOGW("Hardware buffer IDs clash with ours, so clients get only the camera's format");
+            mWarnedAboutBufferIds = true;
+        }
+        conversionAllowed = false;
+    }
 
+    // Each format clients ask for is converted into at most once per frame, and the result
+    // shared between all of them.  We hold a reference to each until we're done here.
+    std::vector<BufferDesc> converted;
 
-Return<void> HalCamera::deliverFrame(const BufferDesc& buffer) {
     // Run through all our clients and deliver this frame to any who are eligible
     unsigned frameDeliveries = 0;
-    for (auto&& client : mClients) {
-        sp<VirtualCamera> virtCam = client.promote();
-        if (virtCam != nullptr) {
-            if (virtCam->deliverFrame(buffer)) {
+    for (auto&& virtCam : clients) {
+        // A client gets the camera's own format if it asked for that, or for one we can't make
+        const int32_t format = virtCam->getFormat();
+        if (!conversionAllowed || !ConvertedFramePool::canConvert(buffer.format, format)) {
+            {
+                // A restart that replaced the camera meanwhile has forgotten its frames, this one
+                // included, so there's nothing left to hand out
+                std::lock_guard<std::mutex> frameLock(mFrameLock);
+                uint32_t* refCount = mFrames.find(buffer.bufferId);
+                if (refCount == nullptr || mFrameGeneration != generation) {
+                    continue;
+                }
+                (*refCount)++;
+            }
+            if (virtCam->deliverFrame(buffer, arrivalTime)) {
                 frameDeliveries++;
+            } else {
+                releaseFrame(buffer, generation);
+            }
+        } else {
+            // Don't spend a conversion on a client which will turn the frame down anyway
+            if (!virtCam->wantsFrame()) {
+                continue;
+            }
+            const BufferDesc* frame = getConvertedFrame(buffer, format, &converted);
+            if (frame == nullptr) {
+                continue;
+            }
+            mConvertedFrames.addRef(*frame);
+            if (virtCam->deliverFrame(*frame, arrivalTime)) {
+                frameDeliveries++;
+            } else {
+                mConvertedFrames.release(*frame);
             }
         }
     }
@@ -192,24 +406,315 @@ Return<void> HalCamera::deliverFrame(const BufferDesc& buffer) {
     if (frameDeliveries < 1) {
         // If none of our clients could accept the frame, then return it right away
         ALOGI("Trivially rejecting frame with no acceptances");
-        mHwCamera->doneWithFrame(buffer);
-    } else {
-        // Add an entry for this frame in our tracking list
-        unsigned i;
-        for (i=0; i<mFrames.size(); i++) {
-            if (mFrames[i].refCount == 0) {
-                break;
+    }
+
+    // Drop our own references, returning the frame to the hardware if nobody else has it
+    for (auto&& frame : converted) {
+        mConvertedFrames.release(frame);
+    }
+    releaseFrame(buffer, generation);
+
+    return Void();
+}
+
+
+// Returns this frame converted to the given format, converting it if no other client has asked
+// for that format yet.  Null if we're out of buffers to convert into.
+const BufferDesc* HalCamera::getConvertedFrame(const BufferDesc& buffer, int32_t format,
+                                               std::vector<BufferDesc>* converted) {
+    for (auto&& frame : *converted) {
+        if (frame.format == static_cast<uint32_t>(format)) {
+            return &frame;
+        }
+    }
+
+    BufferDesc frame = {};
+    if (!mConvertedFrames.convert(buffer, format, &frame)) {
+        return nullptr;
+    }
+    converted->push_back(frame);
+    return &converted->back();
+}
+
+
+void HalCamera::DeathMonitor::serviceDied(uint64_t /*cookie*/,
+                                          const wp<::android::hidl::base::V1_0::IBase>& /*who*/) {
+    sp<HalCamera> camera = mCamera.promote();
+    if (camera != nullptr) {
+        ALOGE("Camera %s died", camera->getId().c_str());
+        camera->requestRestart(true);
+    }
+}
+
+
+// Runs on our watchdog thread for as long as we exist, restarting the hardware stream when it
+// stalls or when asked to by requestRestart()
+void HalCamera::watchdogLoop(wp<HalCamera> weakCamera, std::shared_ptr<WatchdogState> state) {
+    std::unique_lock<std::mutex> lock(state->lock);
+    while (!state->exit) {
+        state->wakeup = false;
+        lock.unlock();
+
+        // If this turns out to be the camera's last reference, its destructor runs right here and
+        // tells us to exit through the state we share
+        bool alive = false;
+        auto wakeTime = std::chrono::steady_clock::time_point::max();
+        {
+            sp<HalCamera> camera = weakCamera.promote();
+            if (camera != nullptr) {
+                alive = true;
+                wakeTime = camera->watchdogPass();
             }
         }
-        if (i == mFrames.size()) {
-            mFrames.emplace_back(buffer.bufferId);
+
+        lock.lock();
+        if (!alive) {
+            // The camera is being destroyed on another thread, which will be waiting for us
+            state->signal.wait(lock, [&state](){ return state->exit; });
+            break;
+        }
+
+        auto woken = [&state](){ return state->exit || state->wakeup; };
+        if (wakeTime == std::chrono::steady_clock::time_point::max()) {
+            state->signal.wait(lock, woken);
         } else {
-            mFrames[i].frameId = buffer.bufferId;
+            state->signal.wait_until(lock, wakeTime, woken);
         }
-        mFrames[i].refCount = frameDeliveries;
     }
+}
 
-    return Void();
+
+// Does whatever the watchdog finds is due, returning when it should next look
+std::chrono::steady_clock::time_point HalCamera::watchdogPass() {
+    bool restart = false;
+    bool reopen = false;
+    bool shrink = false;
+    auto wakeTime = std::chrono::steady_clock::time_point::max();
+    {
+        std::lock_guard<std::mutex> lock(mWatchdog->lock);
+        if (mWatchdog->restartPending) {
+            restart = true;
+            reopen = mWatchdog->reopenPending;
+            mWatchdog->restartPending = false;
+            mWatchdog->reopenPending = false;
+        }
+
+        // Spare buffers go back once our clients' needs have settled
+        if (mWatchdog->shrinkPending) {
+            if (std::chrono::steady_clock::now() >= mWatchdog->shrinkDue) {
+                shrink = true;
+                mWatchdog->shrinkPending = false;
+            } else {
+                wakeTime = mWatchdog->shrinkDue;
+            }
+        }
+    }
+
+    if (restart) {
+        restartStream(reopen);
+    }
+    if (shrink) {
+        shrinkBuffers();
+    }
+
+    // Only a running stream can stall.  We're woken when one starts.
+    if (sWatchdogDeadline.count() != 0 && mStreamState == RUNNING) {
+        // Nor can one whose buffers our clients are all holding, since the hardware has nothing
+        // to capture into.  The clock starts again once a buffer goes back to it.
+        bool starved;
+        {
+            std::lock_guard<std::mutex> frameLock(mFrameLock);
+            starved = mBuffersGranted > 0 && mFrames.size() >= mBuffersGranted;
+        }
+
+        const std::chrono::steady_clock::time_point lastFrame(
+                std::chrono::nanoseconds(mLastFrameTime.load()));
+        auto due = lastFrame + sWatchdogDeadline;
+        if (starved) {
+            due = std::max(due, std::chrono::steady_clock::now() + sWatchdogDeadline);
+        } else if (std::chrono::steady_clock::now() >= due) {
+            ALOGW("No frame from camera %s in %lld ms, so restarting its stream",
+                  mCameraId.c_str(), static_cast<long long>(sWatchdogDeadline.count()));
+            restartStream(false);
+            due = std::chrono::steady_clock::now() + sWatchdogDeadline;
+        }
+        wakeTime = std::min(wakeTime, due);
+    }
+
+    return wakeTime;
+}
+
+
+void HalCamera::requestRestart(bool reopen) {
+    {
+        std::lock_guard<std::mutex> lock(mWatchdog->lock);
+        mWatchdog->restartPending = true;
+        mWatchdog->reopenPending |= reopen;
+        mWatchdog->wakeup = true;
+    }
+    mWatchdog->signal.notify_all();
+}
+
+
+// Has the watchdog look at our stream state again
+void HalCamera::wakeWatchdog() {
+    {
+        std::lock_guard<std::mutex> lock(mWatchdog->lock);
+        mWatchdog->wakeup = true;
+    }
+    mWatchdog->signal.notify_all();
+}
+
+
+// Stops and starts the hardware stream behind our clients' backs, first replacing the hardware
+// camera if it died.  Our clients' streams end only if the hardware one can't be started again.
+void HalCamera::restartStream(bool reopen) {
+    // The new camera has to be opened through our Enumerator, which calls into us with its own
+    // locks held, so do it before taking ours
+    sp<IEvsCamera> newCamera;
+    if (reopen) {
+        sp<Enumerator> enumerator = mEnumerator.promote();
+        if (enumerator != nullptr) {
+            newCamera = enumerator->reopenHwCamera(mCameraId);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> streamLock(mStreamLock);
+        if (reopen) {
+            if (newCamera == nullptr) {
+                ALOGE("Failed to reopen camera %s", mCameraId.c_str());
+            } else {
+                replaceHwCamera_Locked(newCamera);
+            }
+        }
+
+        // If our clients have stopped in the meantime, there's nothing to restart
+        if (mStreamState != RUNNING) {
+            return;
+        }
+        mStreamState = RESTARTING;
+
+        // Its end of stream marker is dropped when it comes back to us
+        sp<IEvsCamera> hwCamera = getHwCamera();
+        if (!reopen) {
+            mStaleEndMarkers++;
+            hwCamera->stopVideoStream();
+        }
+
+        if (!reopen || newCamera != nullptr) {
+            Return<EvsResult> result = hwCamera->startVideoStream(this);
+            if (result.isOk() && result == EvsResult::OK) {
+                markFrameArrival();
+                mStreamState = RUNNING;
+                mRestartCount++;
+                ALOGI("Restarted camera %s stream (%u restarts so far)",
+                      mCameraId.c_str(), mRestartCount.load());
+                return;
+            }
+        }
+
+        ALOGE("Failed to restart camera %s stream", mCameraId.c_str());
+        mStreamState = STOPPED;
+    }
+
+    // Let our clients know their streams have ended
+    BufferDesc nullBuff = {};
+    const auto now = std::chrono::steady_clock::now();
+    for (auto&& virtCam : getClients()) {
+        virtCam->deliverFrame(nullBuff, now);
+    }
+}
+
+
+// Swaps in a newly opened hardware camera for one which died
+void HalCamera::replaceHwCamera_Locked(const sp<IEvsCamera>& hwCamera) {
+    {
+        std::lock_guard<std::mutex> hwLock(mHwLock);
+        mHwCamera = hwCamera;
+    }
+    Return<bool> linked = hwCamera->linkToDeath(mDeathMonitor, 0);
+    if (!linked.isOk() || !linked) {
+        ALOGW("Can't watch for the death of camera %s", mCameraId.c_str());
+    }
+
+    // The frames outstanding died with the old camera.  Any our clients return from now on are
+    // unknown to us, unless the new camera happens to reuse the ID, in which case that frame
+    // goes back to the hardware early.
+    {
+        std::lock_guard<std::mutex> frameLock(mFrameLock);
+        mFrames.clear();
+        mFrameGeneration++;
+    }
+
+    // Bring the new camera up to date with our needs
+    if (mBuffersGranted > 0 && !setHwBufferCount_Locked(mBuffersGranted)) {
+        ALOGE("Failed to set the buffer count on the reopened camera %s", mCameraId.c_str());
+    }
+    updateColorSettings();
+}
+
+
+void HalCamera::markFrameArrival() {
+    mLastFrameTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Takes a snapshot of our live clients, so we can call them without holding mClientLock
+std::vector<sp<VirtualCamera>> HalCamera::getClients() {
+    std::vector<sp<VirtualCamera>> clients;
+
+    std::lock_guard<std::mutex> clientLock(mClientLock);
+    clients.reserve(mClients.size());
+    for (auto&& client : mClients) {
+        sp<VirtualCamera> virtCam = client.promote();
+        if (virtCam != nullptr) {
+            clients.push_back(virtCam);
+        }
+    }
+
+    return clients;
+}
+
+
+// Drops one reference to a frame, returning it to the device layer once they're all gone.  A
+// reference taken before a restart replaced the camera is dropped with the old camera's frames,
+// so isn't taken off a new frame which happens to have the same ID.
+void HalCamera::releaseFrame(const BufferDesc& buffer, unsigned generation) {
+    bool lastReference = false;
+    bool hwStarved = false;
+    {
+        std::lock_guard<std::mutex> frameLock(mFrameLock);
+        if (generation != kAnyGeneration && generation != mFrameGeneration) {
+            return;
+        }
+
+        // Find this frame in our table of outstanding frames
+        uint32_t* refCount = mFrames.find(buffer.bufferId);
+        if (refCount == nullptr) {
+            ALOGE("We got a frame back with an ID we don't recognize!");
+            return;
+        }
+
+        // Are there still clients using this buffer?
+        (*refCount)--;
+        if (*refCount <= 0) {
+            hwStarved = mFrames.size() >= mBuffersGranted;
+            mFrames.erase(buffer.bufferId);
+            lastReference = true;
+        }
+    }
+
+    if (lastReference) {
+        // Since all our clients are done with this buffer, return it to the device layer
+        getHwCamera()->doneWithFrame(buffer);
+
+        // The hardware couldn't capture anything until now, so the watchdog's wait starts here
+        if (hwStarved) {
+            markFrameArrival();
+        }
+    }
 }
 
 } // namespace implementation
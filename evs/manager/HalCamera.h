@@ -21,13 +21,24 @@
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 #include <ui/GraphicBuffer.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <thread>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ConvertedFramePool.h"
+#include "FrameTable.h"
 
 
 using namespace ::android::hardware::automotive::evs::V1_0;
 using ::android::hardware::Return;
 using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_death_recipient;
 
 namespace android {
 namespace automotive {
@@ -37,48 +48,139 @@ namespace implementation {
 
 
 class VirtualCamera;    // From VirtualCamera.h
+class Enumerator;       // From Enumerator.h
 
 
 // This class wraps the actual hardware IEvsCamera objects.  There is a one to many
 // relationship between instances of this class and instances of the VirtualCamera class.
 // This class implements the IEvsCameraStream interface so that it can receive the video
 // stream from the hardware camera and distribute it to the associated VirtualCamera objects.
+// Client calls and frame deliveries may arrive on any of the service's binder threads.
+// If the hardware stream stalls, or the process serving the camera dies, we restart the stream
+// (reopening the camera if need be) without our clients having to do anything.
 class HalCamera : public IEvsCameraStream {
 public:
-    HalCamera(sp<IEvsCamera> hwCamera) : mHwCamera(hwCamera) {};
+    HalCamera(sp<IEvsCamera> hwCamera, const std::string& cameraId,
+              const wp<Enumerator>& enumerator) :
+            mHwCamera(hwCamera), mCameraId(cameraId), mEnumerator(enumerator) {};
+    virtual ~HalCamera();
+
+    // How long a running hardware stream may go without a frame before we restart it.  Zero
+    // turns the watchdog off.  Applies to all cameras, so is expected to be set at startup.
+    static void         setWatchdogDeadline(std::chrono::milliseconds deadline);
 
     // Factory methods for client VirtualCameras
     sp<VirtualCamera>   makeVirtualCamera();
     void                disownVirtualCamera(sp<VirtualCamera> virtualCamera);
 
     // Implementation details
-    sp<IEvsCamera>      getHwCamera()       { return mHwCamera; };
-    unsigned            getClientCount()    { return mClients.size(); };
+    sp<IEvsCamera>      getHwCamera();
+    const std::string&  getId()             { return mCameraId; };
+    unsigned            getRestartCount()   { return mRestartCount; };
+    unsigned            getClientCount();
     bool                changeFramesInFlight(int delta);
+    void                releaseClientBuffers(unsigned count);
 
     Return<EvsResult>   clientStreamStarting();
     void                clientStreamEnding();
     Return<void>        doneWithFrame(const BufferDesc& buffer);
 
+    // Picks up any change to the hardware's color settings for our own format conversions
+    void                updateColorSettings();
+
     // Methods from ::android::hardware::automotive::evs::V1_0::ICarCameraStream follow.
     Return<void> deliverFrame(const BufferDesc& buffer)  override;
 
 private:
+    // Passes word of the hardware camera's death on to its HalCamera
+    class DeathMonitor : public hidl_death_recipient {
+    public:
+        explicit DeathMonitor(const wp<HalCamera>& camera) : mCamera(camera) {};
+        void serviceDied(uint64_t cookie,
+                         const wp<::android::hidl::base::V1_0::IBase>& who) override;
+    private:
+        wp<HalCamera> mCamera;
+    };
+
+    void                            onFirstRef() override;
+    struct WatchdogState;
+    static void                     watchdogLoop(wp<HalCamera> weakCamera,
+                                                 std::shared_ptr<WatchdogState> state);
+    std::chrono::steady_clock::time_point watchdogPass();
+    void                            requestRestart(bool reopen);
+    void                            wakeWatchdog();
+    void                            restartStream(bool reopen);
+    void                            replaceHwCamera_Locked(const sp<IEvsCamera>& hwCamera);
+    void                            markFrameArrival();
+
+    bool                            changeFramesInFlight_Locked(int delta);
+    bool                            setHwBufferCount_Locked(unsigned bufferCount);
+    void                            scheduleShrink();
+    void                            shrinkBuffers();
+    std::vector<sp<VirtualCamera>>  getClients();
+    enum : unsigned { kAnyGeneration = ~0u };
+    void                            releaseFrame(const BufferDesc& buffer,
+                                                 unsigned generation = kAnyGeneration);
+    const BufferDesc*               getConvertedFrame(const BufferDesc& buffer, int32_t format,
+                                                      std::vector<BufferDesc>* converted);
+
+    std::mutex                      mHwLock;    // Guards mHwCamera, which a restart may replace
     sp<IEvsCamera>                  mHwCamera;
+    const std::string               mCameraId;
+    wp<Enumerator>                  mEnumerator;    // Reopens the camera after its death
+    sp<DeathMonitor>                mDeathMonitor;
+
+    // Guards mClients.  Never held while calling into the hardware camera or a client.
+    std::mutex                      mClientLock;
     std::list<wp<VirtualCamera>>    mClients;   // Weak pointers -> objects destruct if client dies
 
-    enum {
+    // Serializes changes to the hardware stream and buffer count.  May be held while calling
+    // into the hardware camera, so frame delivery (which could be a callback from that very
+    // call) must never wait on it.
+    std::mutex                      mStreamLock;
+    enum StreamState {
         STOPPED,
         RUNNING,
         STOPPING,
-    }                               mStreamState = STOPPED;
-
-    struct FrameRecord {
-        uint32_t    frameId;
-        uint32_t    refCount;
-        FrameRecord(uint32_t id) : frameId(id), refCount(0) {};
+        RESTARTING,     // Our clients still think of the stream as running
+    };
+    std::atomic<StreamState>        mStreamState{STOPPED};
+
+    // Watches for the hardware stream stalling, and does the restarts for the other causes too
+    // so that they never happen on a thread delivering frames or a binder callback.  The thread
+    // only holds a strong reference to us while it's working, and may drop our last one, so what
+    // it needs to wait on and find out it's time to exit lives apart from us.
+    struct WatchdogState {
+        std::mutex                  lock;       // Guards everything below
+        std::condition_variable     signal;
+        bool                        exit = false;
+        bool                        wakeup = false;     // Something changed, so look again
+        bool                        restartPending = false;
+        bool                        reopenPending = false;
+        bool                        shrinkPending = false;
+        std::chrono::steady_clock::time_point shrinkDue;
     };
-    std::vector<FrameRecord>        mFrames;
+    std::thread                     mWatchdogThread;
+    std::shared_ptr<WatchdogState>  mWatchdog = std::make_shared<WatchdogState>();
+    std::atomic<int64_t>            mLastFrameTime{0};  // steady_clock nanoseconds
+    std::atomic<unsigned>           mRestartCount{0};
+    std::atomic<unsigned>           mStaleEndMarkers{0};    // From streams we've restarted
+
+    // The hardware's buffer count follows our clients' needs with some slack, so that clients
+    // coming and going (as they do when the driver flips between gears) don't have the hardware
+    // reallocating buffers every time.  It grows straight away, a chunk at a time, but only
+    // shrinks once the need has been lower for a while, which the watchdog thread sees to.
+    std::atomic<unsigned>           mBuffersNeeded{0};  // Sum of our clients' allowances
+    std::atomic<unsigned>           mBuffersGranted{0};     // Changed under mStreamLock
+
+    // How many references are still held to each outstanding frame, by bufferId
+    std::mutex                      mFrameLock;
+    FrameTable<uint32_t>            mFrames;
+    unsigned                        mFrameGeneration = 0;   // Bumped when mFrames is cleared
+
+    // Copies of the current frames for clients wanting a format other than the hardware's
+    ConvertedFramePool              mConvertedFrames;
+    bool                            mWarnedAboutBufferIds = false;
 };
 
 } // namespace implementation
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SyncGroup.h"
+#include "VirtualCamera.h"
+#include "HalCamera.h"
+
+#include <map>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// All the groups with members, by ID
+static std::mutex sGroupLock;
+static std::map<int32_t, std::weak_ptr<SyncGroup>>& getGroups() {
+    static std::map<int32_t, std::weak_ptr<SyncGroup>> sGroups;
+    return sGroups;
+}
+
+
+std::shared_ptr<SyncGroup> SyncGroup::join(int32_t id, const sp<VirtualCamera>& camera) {
+    std::shared_ptr<SyncGroup> group;
+    {
+        std::lock_guard<std::mutex> lock(sGroupLock);
+        auto& groups = getGroups();
+        group = groups[id].lock();
+        if (group == nullptr) {
+            group = std::make_shared<SyncGroup>(id);
+            groups[id] = group;
+        }
+
+        // Forget any groups which have emptied out since we last looked
+        for (auto it = groups.begin(); it != groups.end();) {
+            if (it->second.expired()) {
+                it = groups.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(group->mLock);
+    if (group->findMember_Locked(camera.get()) == nullptr) {
+        Member member;
+        member.key    = camera.get();
+        member.camera = camera;
+        member.halCamera = camera->getHalCamera();
+        member.active = camera->isStreaming();
+        group->mMembers.push_back(member);
+    }
+    return group;
+}
+
+
+void SyncGroup::leave(VirtualCamera* camera) {
+    std::vector<Handoff> toSend;
+    std::vector<Handoff> toReturn;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (auto it = mMembers.begin(); it != mMembers.end(); ++it) {
+            if (it->key == camera) {
+                takeFrame(&*it, &toReturn);
+                mMembers.erase(it);
+                break;
+            }
+        }
+
+        // The others may have been waiting on this one
+        matchFrames_Locked(&toSend, &toReturn);
+    }
+    complete(toSend, toReturn);
+}
+
+
+void SyncGroup::setActive(VirtualCamera* camera, bool active) {
+    std::vector<Handoff> toSend;
+    std::vector<Handoff> toReturn;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        Member* member = findMember_Locked(camera);
+        if (member == nullptr) {
+            return;
+        }
+        member->active = active;
+        if (!active) {
+            takeFrame(member, &toReturn);
+            matchFrames_Locked(&toSend, &toReturn);
+        }
+    }
+    complete(toSend, toReturn);
+}
+
+
+bool SyncGroup::offerFrame(VirtualCamera* camera, const BufferDesc& frame,
+                           std::chrono::steady_clock::time_point arrivalTime) {
+    std::vector<Handoff> toSend;
+    std::vector<Handoff> toReturn;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        Member* member = findMember_Locked(camera);
+        if (member == nullptr || !member->active) {
+            // Raced with the member leaving or stopping
+            return false;
+        }
+
+        // The member's older frame didn't make a set in time, so it's replaced
+        takeFrame(member, &toReturn);
+        member->hasFrame    = true;
+        member->frame       = frame;
+        member->arrivalTime = arrivalTime;
+
+        matchFrames_Locked(&toSend, &toReturn);
+    }
+    complete(toSend, toReturn);
+    return true;
+}
+
+
+void SyncGroup::setTolerance(std::chrono::microseconds tolerance) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mTolerance = tolerance;
+}
+
+
+unsigned SyncGroup::getToleranceUs() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return std::chrono::duration_cast<std::chrono::microseconds>(mTolerance).count();
+}
+
+
+SyncGroup::Member* SyncGroup::findMember_Locked(VirtualCamera* camera) {
+    for (auto&& member : mMembers) {
+        if (member.key == camera) {
+            return &member;
+        }
+    }
+    return nullptr;
+}
+
+
+// Looks for a complete set among the waiting frames.  If the frames waiting are too far apart,
+// the oldest can never be part of a set (every other member's next frame will be later still),
+// so it is given up.
+void SyncGroup::matchFrames_Locked(std::vector<Handoff>* toSend, std::vector<Handoff>* toReturn) {
+    Member* oldest = nullptr;
+    Member* newest = nullptr;
+    for (auto&& member : mMembers) {
+        if (!member.active) {
+            continue;
+        }
+        if (!member.hasFrame) {
+            // Still waiting on this one
+            return;
+        }
+        if (oldest == nullptr || member.arrivalTime < oldest->arrivalTime) {
+            oldest = &member;
+        }
+        if (newest == nullptr || member.arrivalTime > newest->arrivalTime) {
+            newest = &member;
+        }
+    }
+    if (oldest == nullptr) {
+        // Nobody is streaming
+        return;
+    }
+
+    if (newest->arrivalTime - oldest->arrivalTime > mTolerance) {
+        takeFrame(oldest, toReturn);
+        return;
+    }
+
+    // We have a set, so send it all out together
+    for (auto&& member : mMembers) {
+        if (member.active) {
+            takeFrame(&member, toSend);
+        }
+    }
+    mSetCount++;
+}
+
+
+void SyncGroup::takeFrame(Member* member, std::vector<Handoff>* handoffs) {
+    if (member->hasFrame) {
+        handoffs->push_back({ member->camera, member->halCamera, member->frame });
+        member->hasFrame = false;
+        member->frame = {};
+    }
+}
+
+
+// Passes on the frames decided on under the lock, now that it isn't held.  Frames go straight
+// back to the hardware camera if their member has gone away.
+void SyncGroup::complete(const std::vector<Handoff>& toSend, const std::vector<Handoff>& toReturn) {
+    for (auto&& handoff : toSend) {
+        sp<VirtualCamera> camera = handoff.camera.promote();
+        if (camera == nullptr || !camera->sendGroupFrame(handoff.frame)) {
+            handoff.halCamera->doneWithFrame(handoff.frame);
+        }
+    }
+    for (auto&& handoff : toReturn) {
+        handoff.halCamera->doneWithFrame(handoff.frame);
+    }
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_SYNCGROUP_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_SYNCGROUP_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <utils/StrongPointer.h>
+#include <utils/RefBase.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+class VirtualCamera;    // From VirtualCamera.h
+class HalCamera;        // From HalCamera.h
+
+
+// A set of client cameras (typically one client's view of several hardware cameras) whose
+// frames are passed on together.  Each member's newest frame waits here until every streaming
+// member has one and they all arrived within the group's tolerance of each other.  The set then
+// goes out to all the members at once, so a client stitching the images gets consistent ones.
+// Frames which can no longer be part of a set are given back to the hardware.
+class SyncGroup {
+public:
+    // Finds the group with the given (client chosen) ID, creating it if need be, and adds the
+    // camera to it.  The group lives as long as it has members.
+    static std::shared_ptr<SyncGroup> join(int32_t id, const sp<VirtualCamera>& camera);
+    void leave(VirtualCamera* camera);
+
+    // Only streaming members have to contribute to a set
+    void setActive(VirtualCamera* camera, bool active);
+
+    // Hands over a frame the camera has accepted from its hardware camera.  Returns false,
+    // leaving the frame with the caller, if the camera isn't a streaming member.
+    bool offerFrame(VirtualCamera* camera, const BufferDesc& frame,
+                    std::chrono::steady_clock::time_point arrivalTime);
+
+    int32_t  getId()                    { return mId; };
+    void     setTolerance(std::chrono::microseconds tolerance);
+    unsigned getToleranceUs();
+    unsigned getSetCount()              { return mSetCount; };
+
+    explicit SyncGroup(int32_t id) : mId(id) {};
+
+private:
+    struct Member {
+        VirtualCamera*  key;        // Identifies the member without keeping it alive
+        wp<VirtualCamera> camera;
+        sp<HalCamera>   halCamera;  // Where frames we give up go back to
+        bool            active = false;
+        bool            hasFrame = false;
+        BufferDesc      frame = {};
+        std::chrono::steady_clock::time_point arrivalTime;
+    };
+
+    // A frame and who it should go to (or come back from)
+    struct Handoff {
+        wp<VirtualCamera>   camera;
+        sp<HalCamera>       halCamera;
+        BufferDesc          frame;
+    };
+
+    Member* findMember_Locked(VirtualCamera* camera);
+    void    matchFrames_Locked(std::vector<Handoff>* toSend, std::vector<Handoff>* toReturn);
+    static void takeFrame(Member* member, std::vector<Handoff>* handoffs);
+    static void complete(const std::vector<Handoff>& toSend,
+                         const std::vector<Handoff>& toReturn);
+
+    const int32_t               mId;
+    std::mutex                  mLock;      // Never held while calling into a member
+    std::vector<Member>         mMembers;
+    std::chrono::steady_clock::duration mTolerance = std::chrono::milliseconds(10);
+    std::atomic<unsigned>       mSetCount{0};
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_SYNCGROUP_H
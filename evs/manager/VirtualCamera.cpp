@@ -17,6 +17,10 @@
 #include "VirtualCamera.h"
 #include "HalCamera.h"
 #include "Enumerator.h"
+#include "SyncGroup.h"
+#include "ConvertedFramePool.h"
+
+#include "EvsExtendedInfo.h"
 
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
@@ -29,8 +33,27 @@ namespace V1_0 {
 namespace implementation {
 
 
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_FRAMES_OVERFLOWED;
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_FRAME_RATE;
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_DELIVERY_POLICY;
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_SYNC_GROUP;
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_SYNC_TOLERANCE_US;
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_SYNC_SETS;
+using ::android::automotive::evs::support::EXTENDED_INFO_CLIENT_FORMAT;
+using ::android::automotive::evs::support::EXTENDED_INFO_STREAM_RESTARTS;
+using ::android::automotive::evs::support::EXTENDED_INFO_COLOR_MATRIX;
+using ::android::automotive::evs::support::EXTENDED_INFO_COLOR_RANGE;
+using ::android::automotive::evs::support::DELIVERY_POLICY_DROP_NEWEST;
+using ::android::automotive::evs::support::DELIVERY_POLICY_LATEST_WINS;
+
+
+// How many frames may wait to be sent to a client which isn't keeping up
+static const unsigned kDeliveryQueueDepth = 4;
+
+
 VirtualCamera::VirtualCamera(sp<HalCamera> halCamera) :
-    mHalCamera(halCamera) {
+    mHalCamera(halCamera),
+    mDeliveryQueue(kDeliveryQueueDepth) {
 }
 
 
@@ -40,76 +63,184 @@ VirtualCamera::~VirtualCamera() {
 
 
 void VirtualCamera::shutdown() {
-    // In normal operation, the stream should already be stopped by the time we get here
-    if (mStreamState != STOPPED) {
-        // Note that if we hit this case, no terminating frame will be sent to the client,
-        // but they're probably already dead anyway.
-        ALOGW("Virtual camera being shutdown while stream is running");
-        mStreamState = STOPPED;
-
-        if (mFramesHeld.size() > 0) {
-            ALOGW("VirtualCamera destructing with frames in flight.");
-
-            // Return to the underlying hardware camera any buffers the client was holding
-            for (auto&& heldBuffer : mFramesHeld) {
-                // Tell our parent that we're done with this buffer
-                mHalCamera->doneWithFrame(heldBuffer);
+    // Anything still queued goes out before the held frames are reclaimed below
+    stopDeliveryThread();
+
+    std::vector<BufferDesc> framesToReturn;
+    std::shared_ptr<SyncGroup> group;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        takePendingFrame_Locked(&framesToReturn);
+        group = std::move(mSyncGroup);
+
+        // In normal operation, the stream should already be stopped by the time we get here
+        if (mStreamState != STOPPED) {
+            // Note that if we hit this case, no terminating frame will be sent to the client,
+            // but they're probably already dead anyway.
+            ALOGW("Virtual camera being shutdown while stream is running");
+            mStreamState = STOPPED;
+
+            if (mFramesHeld.size() > 0) {
+                ALOGW("VirtualCamera destructing with frames in flight.");
+
+                // Return to the underlying hardware camera any buffers the client was holding
+                mFramesHeld.forEach([&framesToReturn](uint32_t, const BufferDesc& heldBuffer) {
+                    framesToReturn.push_back(heldBuffer);
+                });
+                mFramesHeld.clear();
             }
-            mFramesHeld.clear();
         }
     }
+    returnFrames(framesToReturn);
+
+    // Any frame of ours still waiting in the group goes back to the hardware
+    if (group != nullptr) {
+        group->leave(this);
+    }
 
-    // Drop our reference to our associated hardware camera
-    mHalCamera = nullptr;
+    // Give back our buffer allowance, and drop our reference to our associated hardware camera.
+    // Calls already under way keep their own reference until they're done with it.
+    sp<HalCamera> halCamera;
+    {
+        std::lock_guard<std::mutex> allowanceLock(mAllowanceLock);
+        {
+            std::lock_guard<std::mutex> lock(mAccessLock);
+            halCamera = mHalCamera;
+            mHalCamera = nullptr;
+        }
+        if (halCamera != nullptr) {
+            halCamera->releaseClientBuffers(mFramesAllowed);
+        }
+    }
 }
 
 
-bool VirtualCamera::deliverFrame(const BufferDesc& buffer) {
-    if (buffer.memHandle == nullptr) {
-        // Warn if we got an unexpected stream termination
-        if (mStreamState != STOPPING) {
-            // TODO:  Should we suicide in this case to trigger a restart of the stack?
-            ALOGW("Stream unexpectedly stopped");
-        }
+sp<HalCamera> VirtualCamera::getHalCamera() {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    return mHalCamera;
+}
 
-        // This is the stream end marker, so send it along, then mark the stream as stopped
-        mStream->deliverFrame(buffer);
-        mStreamState = STOPPED;
-        return true;
-    } else {
-        if (mStreamState == STOPPED) {
-            // A stopped stream gets no frames
-            return false;
+
+bool VirtualCamera::deliverFrame(const BufferDesc& buffer,
+                                 std::chrono::steady_clock::time_point arrivalTime) {
+    std::vector<BufferDesc> framesToReturn;
+    std::shared_ptr<SyncGroup> group;
+    bool accepted = false;
+    bool streamEnded = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        if (buffer.memHandle == nullptr) {
+            // If we're stopping, stopVideoStream() sends the client its own end marker, and if
+            // we're already stopped there's nobody to tell
+            if (mStreamState == RUNNING) {
+                // Our HalCamera only passes this on if it couldn't restart the hardware stream
+                ALOGW("Stream unexpectedly stopped");
+
+                // A frame still waiting for the client to make room will never be sent now
+                takePendingFrame_Locked(&framesToReturn);
+
+                // This is the stream end marker, so send it along behind any frames still
+                // queued, then mark the stream as stopped.  It must not be dropped, so wait for
+                // room if need be.
+                mDeliveryQueue.push(buffer);
+                mStreamState = STOPPED;
+                streamEnded = true;
+            }
+            group = mSyncGroup;
+            accepted = true;
+        } else if (mStreamState != RUNNING) {
+            // A stopped (or stopping) stream gets no frames
+        } else if (!takeFrameIfDue_Locked()) {
+            // The client asked for a lower frame rate and this frame isn't one it gets
+        } else if (mSyncGroup != nullptr) {
+            // The frame goes to the group to wait for the others' (once we've let go of our lock),
+            // and is checked against our quota when its set is complete
+            group = mSyncGroup;
+            accepted = true;
         } else if (mFramesHeld.size() >= mFramesAllowed) {
-            // Indicate that we declined to send the frame to the client because they're at quota
-            ALOGI("Skipping new frame as we hold %zu of %u allowed.",
-                  mFramesHeld.size(), mFramesAllowed);
-            return false;
+            // The client is at quota.  This happens every frame for a slow client, so it's only
+            // reported at stream end.
+            mFramesOverQuota++;
+            if (mDeliveryPolicy == DELIVERY_POLICY_LATEST_WINS) {
+                // Hang onto this frame to send as soon as the client returns one, giving back the
+                // older one it replaces
+                takePendingFrame_Locked(&framesToReturn);
+                mPendingFrame = buffer;
+                mHasPendingFrame = true;
+                accepted = true;
+            }
         } else {
-            // Keep a record of this frame so we can clean up if we have to in case of client death
-            mFramesHeld.push_back(buffer);
+            accepted = sendFrame_Locked(buffer);
+        }
+    }
 
-            // Pass this buffer through to our client
-            mStream->deliverFrame(buffer);
-            return true;
+    if (group != nullptr) {
+        if (streamEnded) {
+            // The rest of the group mustn't wait on us any more
+            group->setActive(this, false);
+        } else if (buffer.memHandle != nullptr &&
+                   !group->offerFrame(this, buffer, arrivalTime)) {
+            // We've stopped (or left the group) since accepting the frame
+            framesToReturn.push_back(buffer);
         }
     }
+
+    returnFrames(framesToReturn);
+    return accepted;
+}
+
+
+bool VirtualCamera::wantsFrame() {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    return mStreamState == RUNNING && isFrameDue_Locked(std::chrono::steady_clock::now());
+}
+
+
+bool VirtualCamera::sendGroupFrame(const BufferDesc& buffer) {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    if (mStreamState != RUNNING) {
+        return false;
+    }
+
+    // A set is only useful complete, so there's no holding a frame back for a client at quota
+    // the way DELIVERY_POLICY_LATEST_WINS does
+    if (mFramesHeld.size() >= mFramesAllowed) {
+        mFramesOverQuota++;
+        return false;
+    }
+    return sendFrame_Locked(buffer);
 }
 
 
 // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
 Return<void> VirtualCamera::getCameraInfo(getCameraInfo_cb info_cb) {
+    sp<HalCamera> halCamera = getHalCamera();
+    if (halCamera == nullptr) {
+        ALOGE("ignoring getCameraInfo call on a closed camera");
+        return Void();
+    }
+
     // Straight pass through to hardware layer
-    return mHalCamera->getHwCamera()->getCameraInfo(info_cb);
+    return halCamera->getHwCamera()->getCameraInfo(info_cb);
 }
 
 
 Return<EvsResult> VirtualCamera::setMaxFramesInFlight(uint32_t bufferCount) {
+    // Our allowance mustn't change between reading it here and storing the new one, nor once
+    // shutdown() has given it back
+    std::lock_guard<std::mutex> allowanceLock(mAllowanceLock);
+    sp<HalCamera> halCamera = getHalCamera();
+    if (halCamera == nullptr) {
+        return EvsResult::OWNERSHIP_LOST;
+    }
+
     // How many buffers are we trying to add (or remove if negative)
     int bufferCountChange = bufferCount - mFramesAllowed;
 
     // Ask our parent for more buffers
-    bool result = mHalCamera->changeFramesInFlight(bufferCountChange);
+    bool result = halCamera->changeFramesInFlight(bufferCountChange);
     if (!result) {
         ALOGE("Failed to change buffer count by %d to %d", bufferCountChange, bufferCount);
         return EvsResult::BUFFER_NOT_AVAILABLE;
@@ -122,31 +253,61 @@ Return<EvsResult> VirtualCamera::setMaxFramesInFlight(uint32_t bufferCount) {
 
 
 Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCameraStream>& stream)  {
-    // We only support a single stream at a time
-    if (mStreamState != STOPPED) {
-        ALOGE("ignoring startVideoStream call when a stream is already running.");
-        return EvsResult::STREAM_ALREADY_RUNNING;
-    }
+    sp<HalCamera> halCamera;
+    std::shared_ptr<SyncGroup> group;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mHalCamera == nullptr) {
+            return EvsResult::OWNERSHIP_LOST;
+        }
+        halCamera = mHalCamera;
+
+        // We only support a single stream at a time
+        if (mStreamState != STOPPED) {
+            ALOGE("ignoring startVideoStream call when a stream is already running.");
+            return EvsResult::STREAM_ALREADY_RUNNING;
+        }
+
+        // Validate our held frame count is starting out at zero as we expect
+        assert(mFramesHeld.size() == 0);
+
+        // A stream which ended from the hardware side may have left the last thread running.
+        // It doesn't use our lock, so this can't deadlock.
+        stopDeliveryThread();
+
+        // Record the user's callback for use when we have a frame ready
+        mStream = stream;
+
+        // Start the thread which passes frames on to the client
+        mFramesOverflowed = 0;
+        mFramesOverQuota = 0;
+        mNextFrameTime = std::chrono::steady_clock::time_point();
+        mDeliveryQueue.reopen();
+        mDeliveryThread = std::thread([this](){ deliverQueuedFrames(); });
 
-    // Validate our held frame count is starting out at zero as we expect
-    assert(mFramesHeld.size() == 0);
+        mStreamState = RUNNING;
+        group = mSyncGroup;
+    }
 
-    // Record the user's callback for use when we have a frame ready
-    mStream = stream;
-    mStreamState = RUNNING;
+    // The rest of our group waits for our frames from now on
+    if (group != nullptr) {
+        group->setActive(this, true);
+    }
 
     // Tell the underlying camera hardware that we want to stream
-    Return<EvsResult> result = mHalCamera->clientStreamStarting();
+    Return<EvsResult> result = halCamera->clientStreamStarting();
     if ((!result.isOk()) || (result != EvsResult::OK)) {
         // If we failed to start the underlying stream, then we're not actually running
-        mStream = nullptr;
         mStreamState = STOPPED;
+        if (group != nullptr) {
+            group->setActive(this, false);
+        }
+        stopDeliveryThread();
+        mStream = nullptr;
         return EvsResult::UNDERLYING_SERVICE_ERROR;
     }
 
-    // TODO:  Detect and exit if we encounter a stalled stream or unresponsive driver?
-    // Consider using a timer and watching for frame arrival?
-
+    // If the hardware stream stalls from here on, our HalCamera restarts it behind our back
     return EvsResult::OK;
 }
 
@@ -154,52 +315,84 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
 Return<void> VirtualCamera::doneWithFrame(const BufferDesc& buffer) {
     if (buffer.memHandle == nullptr) {
         ALOGE("ignoring doneWithFrame called with invalid handle");
-    } else {
-        // Find this buffer in our "held" list
-        auto it = mFramesHeld.begin();
-        while (it != mFramesHeld.end()) {
-            if (it->bufferId == buffer.bufferId) {
-                // found it!
-                break;
-            }
-            ++it;
-        }
-        if (it == mFramesHeld.end()) {
-            // We should always find the frame in our "held" list
+        return Void();
+    }
+
+    std::vector<BufferDesc> framesToReturn;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        // Take this buffer out of our "held" table
+        if (!mFramesHeld.erase(buffer.bufferId)) {
+            // We should always find the frame in our "held" table
             ALOGE("Ignoring doneWithFrame called with unrecognized frameID %d", buffer.bufferId);
-        } else {
-            // Take this frame out of our "held" list
-            mFramesHeld.erase(it);
+            return Void();
+        }
+
+        // Tell our parent that we're done with this buffer
+        framesToReturn.push_back(buffer);
 
-            // Tell our parent that we're done with this buffer
-            mHalCamera->doneWithFrame(buffer);
+        // The client has room for the frame we've been holding back for it
+        if (mHasPendingFrame) {
+            mHasPendingFrame = false;
+            if (!sendFrame_Locked(mPendingFrame)) {
+                // We already told our parent we'd take this one, so give it back
+                framesToReturn.push_back(mPendingFrame);
+            }
+            mPendingFrame = {};
         }
     }
+    returnFrames(framesToReturn);
 
     return Void();
 }
 
 
 Return<void> VirtualCamera::stopVideoStream()  {
-    if (mStreamState == RUNNING) {
+    std::vector<BufferDesc> framesToReturn;
+    std::shared_ptr<SyncGroup> group;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mStreamState != RUNNING) {
+            return Void();
+        }
+
         // Tell the frame delivery pipeline we don't want any more frames
         mStreamState = STOPPING;
+        takePendingFrame_Locked(&framesToReturn);
+        group = mSyncGroup;
+    }
+    returnFrames(framesToReturn);
 
-        // Deliver an empty frame to close out the frame stream
-        BufferDesc nullBuff = {};
-        auto result = mStream->deliverFrame(nullBuff);
-        if (!result.isOk()) {
-            ALOGE("Error delivering end of stream marker");
-        }
+    // Give back any frame of ours waiting in the group, and stop the others waiting for more
+    if (group != nullptr) {
+        group->setActive(this, false);
+    }
 
-        // Since we are single threaded, no frame can be delivered while this function is running,
-        // so we can go directly to the STOPPED state here on the server.
-        // Note, however, that there still might be frames already queued that client will see
-        // after returning from the client side of this call.
-        mStreamState = STOPPED;
+    // Deliver an empty frame to close out the frame stream, after whatever the client
+    // hasn't been sent yet
+    BufferDesc nullBuff = {};
+    mDeliveryQueue.push(nullBuff);
+    stopDeliveryThread();
 
-        // Give the underlying hardware camera the heads up that it might be time to stop
-        mHalCamera->clientStreamEnding();
+    if (mFramesOverflowed > 0) {
+        ALOGI("Client fell behind and missed %u frames", mFramesOverflowed.load());
+    }
+    if (mFramesOverQuota > 0) {
+        ALOGI("Skipped %u frames while the client held all %u it is allowed",
+              mFramesOverQuota, mFramesAllowed.load());
+    }
+
+    // No frame is accepted while we're STOPPING and the end marker has been sent, so we can go
+    // directly to the STOPPED state here on the server.
+    // Note, however, that there still might be frames already queued that client will see
+    // after returning from the client side of this call.
+    mStreamState = STOPPED;
+
+    // Give the underlying hardware camera the heads up that it might be time to stop
+    sp<HalCamera> halCamera = getHalCamera();
+    if (halCamera != nullptr) {
+        halCamera->clientStreamEnding();
     }
 
     return Void();
@@ -207,15 +400,238 @@ Return<void> VirtualCamera::stopVideoStream()  {
 
 
 Return<int32_t> VirtualCamera::getExtendedInfo(uint32_t opaqueIdentifier)  {
+    // Our own statistics are answered here rather than by the hardware
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        switch (opaqueIdentifier) {
+        case EXTENDED_INFO_CLIENT_FRAMES_OVERFLOWED:    return mFramesOverflowed.load();
+        case EXTENDED_INFO_CLIENT_FRAME_RATE:           return mFrameRate;
+        case EXTENDED_INFO_CLIENT_DELIVERY_POLICY:      return mDeliveryPolicy;
+        case EXTENDED_INFO_CLIENT_SYNC_GROUP:
+            return mSyncGroup ? mSyncGroup->getId() : 0;
+        case EXTENDED_INFO_CLIENT_SYNC_TOLERANCE_US:
+            return mSyncGroup ? mSyncGroup->getToleranceUs() : 0;
+        case EXTENDED_INFO_CLIENT_SYNC_SETS:
+            return mSyncGroup ? mSyncGroup->getSetCount() : 0;
+        case EXTENDED_INFO_CLIENT_FORMAT:               return mFormat;
+        default:                                        break;
+        }
+    }
+
+    sp<HalCamera> halCamera = getHalCamera();
+    if (halCamera == nullptr) {
+        return 0;
+    }
+    if (opaqueIdentifier == EXTENDED_INFO_STREAM_RESTARTS) {
+        return halCamera->getRestartCount();
+    }
+
     // Pass straight through to the hardware device
-    return mHalCamera->getHwCamera()->getExtendedInfo(opaqueIdentifier);
+    return halCamera->getHwCamera()->getExtendedInfo(opaqueIdentifier);
 }
 
 
 Return<EvsResult> VirtualCamera::setExtendedInfo(uint32_t opaqueIdentifier, int32_t opaqueValue)  {
+    // The frame rate is a property of this client alone, so it never reaches the hardware
+    if (opaqueIdentifier == EXTENDED_INFO_CLIENT_FRAME_RATE) {
+        if (opaqueValue < 0) {
+            return EvsResult::INVALID_ARG;
+        }
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mFrameRate = opaqueValue;
+        mFrameInterval = mFrameRate ?
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::seconds(1)) / mFrameRate :
+                std::chrono::steady_clock::duration(0);
+        mNextFrameTime = std::chrono::steady_clock::time_point();
+        return EvsResult::OK;
+    }
+    if (opaqueIdentifier == EXTENDED_INFO_CLIENT_DELIVERY_POLICY) {
+        if (opaqueValue != DELIVERY_POLICY_DROP_NEWEST &&
+            opaqueValue != DELIVERY_POLICY_LATEST_WINS) {
+            return EvsResult::INVALID_ARG;
+        }
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mDeliveryPolicy = opaqueValue;
+        return EvsResult::OK;
+    }
+    if (opaqueIdentifier == EXTENDED_INFO_CLIENT_FORMAT) {
+        if (opaqueValue != 0 && !ConvertedFramePool::isSupportedFormat(opaqueValue)) {
+            return EvsResult::INVALID_ARG;
+        }
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mStreamState != STOPPED) {
+            return EvsResult::STREAM_ALREADY_RUNNING;
+        }
+        mFormat = opaqueValue;
+        return EvsResult::OK;
+    }
+    if (opaqueIdentifier == EXTENDED_INFO_CLIENT_SYNC_GROUP) {
+        return setSyncGroup(opaqueValue);
+    }
+    if (opaqueIdentifier == EXTENDED_INFO_CLIENT_SYNC_TOLERANCE_US) {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (opaqueValue < 0 || mSyncGroup == nullptr) {
+            return EvsResult::INVALID_ARG;
+        }
+        mSyncGroup->setTolerance(std::chrono::microseconds(opaqueValue));
+        return EvsResult::OK;
+    }
+
+    sp<HalCamera> halCamera = getHalCamera();
+    if (halCamera == nullptr) {
+        return EvsResult::OWNERSHIP_LOST;
+    }
+
     // Pass straight through to the hardware device
     // TODO: Should we restrict access to this entry point somehow?
-    return mHalCamera->getHwCamera()->setExtendedInfo(opaqueIdentifier, opaqueValue);
+    Return<EvsResult> result = halCamera->getHwCamera()->setExtendedInfo(opaqueIdentifier,
+                                                                         opaqueValue);
+
+    // Frames we convert for our clients have to match the new colors too
+    if ((opaqueIdentifier == EXTENDED_INFO_COLOR_MATRIX ||
+         opaqueIdentifier == EXTENDED_INFO_COLOR_RANGE) &&
+        result.isOk() && result == EvsResult::OK) {
+        halCamera->updateColorSettings();
+    }
+    return result;
+}
+
+
+// Moves this camera into the group with the given ID, or out of any group if it is zero
+EvsResult VirtualCamera::setSyncGroup(int32_t groupId) {
+    if (groupId < 0) {
+        return EvsResult::INVALID_ARG;
+    }
+
+    // The group calls back into us, so it's never joined or left with our lock held
+    std::shared_ptr<SyncGroup> oldGroup;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mSyncGroup != nullptr && mSyncGroup->getId() == groupId) {
+            return EvsResult::OK;
+        }
+        oldGroup = std::move(mSyncGroup);
+        mSyncGroup = nullptr;
+    }
+    if (oldGroup != nullptr) {
+        oldGroup->leave(this);
+    }
+
+    if (groupId != 0) {
+        std::shared_ptr<SyncGroup> newGroup = SyncGroup::join(groupId, this);
+        std::shared_ptr<SyncGroup> displaced;   // In case of a racing call
+        {
+            std::lock_guard<std::mutex> lock(mAccessLock);
+            displaced = std::move(mSyncGroup);
+            mSyncGroup = newGroup;
+        }
+        if (displaced != nullptr && displaced != newGroup) {
+            displaced->leave(this);
+        }
+    }
+    return EvsResult::OK;
+}
+
+
+// Decides whether a frame arriving at the given time is one the client gets at its requested
+// frame rate
+bool VirtualCamera::isFrameDue_Locked(std::chrono::steady_clock::time_point now) {
+    if (mFrameRate == 0) {
+        return true;
+    }
+
+    // Camera frames don't arrive exactly on our schedule, so take the first one within a
+    // quarter interval of when the next is due.  Without the slack a frame arriving a hair
+    // early would be skipped and we'd settle at a lower rate than asked for.
+    return now + mFrameInterval / 4 >= mNextFrameTime;
+}
+
+
+// Decides whether the frame arriving now is one the client gets, and if so schedules the next
+bool VirtualCamera::takeFrameIfDue_Locked() {
+    const auto now = std::chrono::steady_clock::now();
+    if (!isFrameDue_Locked(now)) {
+        return false;
+    }
+    if (mFrameRate == 0) {
+        return true;
+    }
+
+    // Stay on schedule so the rate averages out right, unless we've fallen well behind it
+    // (ie: the first frame, or a stall in the camera)
+    mNextFrameTime += mFrameInterval;
+    if (mNextFrameTime < now) {
+        mNextFrameTime = now + mFrameInterval;
+    }
+    return true;
+}
+
+
+// Queues a frame for the client.  Returns false if the client is too far behind to take it.
+bool VirtualCamera::sendFrame_Locked(const BufferDesc& buffer) {
+    // Keep a record of this frame so we can clean up if we have to in case of client death
+    // (it's recorded before it's queued since the client may return it right away)
+    mFramesHeld.insert(buffer.bufferId, buffer);
+
+    // Pass this buffer through to our client
+    if (!mDeliveryQueue.tryPush(buffer)) {
+        // The client isn't keeping up with the frames already queued for it
+        mFramesHeld.erase(buffer.bufferId);
+        mFramesOverflowed++;
+        return false;
+    }
+    return true;
+}
+
+
+// Hands over the frame held back for a client at quota, if any, to be returned
+void VirtualCamera::takePendingFrame_Locked(std::vector<BufferDesc>* frames) {
+    if (mHasPendingFrame) {
+        mHasPendingFrame = false;
+        frames->push_back(mPendingFrame);
+        mPendingFrame = {};
+    }
+}
+
+
+// Gives frames back to the hardware camera.  Called without mAccessLock held.
+void VirtualCamera::returnFrames(const std::vector<BufferDesc>& frames) {
+    if (frames.empty()) {
+        return;
+    }
+    sp<HalCamera> halCamera = getHalCamera();
+    if (halCamera == nullptr) {
+        return;
+    }
+    for (auto&& frame : frames) {
+        halCamera->doneWithFrame(frame);
+    }
+}
+
+
+// Runs on our delivery thread, passing frames through to the client in the order accepted
+void VirtualCamera::deliverQueuedFrames() {
+    BufferDesc buffer;
+    while (mDeliveryQueue.pop(&buffer)) {
+        auto result = mStream->deliverFrame(buffer);
+        if (!result.isOk()) {
+            if (buffer.memHandle == nullptr) {
+                ALOGE("Error delivering end of stream marker");
+            } else {
+                ALOGE("Error delivering frame %u to client", buffer.bufferId);
+            }
+        }
+    }
+}
+
+
+// Sends whatever is left in the queue, then waits for the delivery thread to finish
+void VirtualCamera::stopDeliveryThread() {
+    mDeliveryQueue.close();
+    if (mDeliveryThread.joinable()) {
+        mDeliveryThread.join();
+    }
 }
 
 } // namespace implementation
@@ -21,8 +21,16 @@
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 #include <ui/GraphicBuffer.h>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <thread>
-#include <deque>
+#include <vector>
+
+#include "EvsExtendedInfo.h"
+#include "FrameTable.h"
+#include "StageQueue.h"
 
 
 using namespace ::android::hardware::automotive::evs::V1_0;
@@ -37,24 +45,41 @@ namespace V1_0 {
 namespace implementation {
 
 
+using ::android::automotive::evs::support::StageQueue;
+
+
 class HalCamera;        // From HalCamera.h
+class SyncGroup;        // From SyncGroup.h
 
 
 // This class represents an EVS camera to the client application.  As such it presents
 // the IEvsCamera interface, and also proxies the frame delivery to the client's
 // IEvsCameraStream object.
+// The client's calls and frame deliveries from the HalCamera may arrive on different threads.
 class VirtualCamera : public IEvsCamera {
 public:
     explicit VirtualCamera(sp<HalCamera> halCamera);
     virtual ~VirtualCamera();
     void                shutdown();
 
-    sp<HalCamera>       getHalCamera()      { return mHalCamera; };
+    sp<HalCamera>       getHalCamera();     // Null once we've been shut down
     unsigned            getAllowedBuffers() { return mFramesAllowed; };
     bool                isStreaming()       { return mStreamState == RUNNING; }
+    int32_t             getFormat()         { return mFormat; };
+
+    // Whether a frame arriving now would be accepted, barring the client being at quota.  Lets
+    // our HalCamera skip preparing frames we'd turn down.
+    bool                wantsFrame();
+
+    // Proxy to receive frames and forward them to the client's stream.  A true return means
+    // we now hold a reference to the frame which will come back through
+    // HalCamera::doneWithFrame().
+    bool                deliverFrame(const BufferDesc& buffer,
+                                     std::chrono::steady_clock::time_point arrivalTime);
 
-    // Proxy to receive frames and forward them to the client's stream
-    bool                deliverFrame(const BufferDesc& buffer);
+    // Called by our SyncGroup when a frame we gave it completes a set.  Returns false if the
+    // client can't take it, in which case the caller still owns the frame.
+    bool                sendGroupFrame(const BufferDesc& buffer);
 
     // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
     Return<void>        getCameraInfo(getCameraInfo_cb _hidl_cb)  override;
@@ -66,16 +91,65 @@ public:
     Return<EvsResult>   setExtendedInfo(uint32_t opaqueIdentifier, int32_t opaqueValue) override;
 
 private:
+    void                deliverQueuedFrames();
+    void                stopDeliveryThread();
+    EvsResult           setSyncGroup(int32_t groupId);
+    // These are expected to be called while mAccessLock is held
+    bool                isFrameDue_Locked(std::chrono::steady_clock::time_point now);
+    bool                takeFrameIfDue_Locked();
+    bool                sendFrame_Locked(const BufferDesc& buffer);
+    void                takePendingFrame_Locked(std::vector<BufferDesc>* frames);
+
+    void                returnFrames(const std::vector<BufferDesc>& frames);
+
     sp<HalCamera>           mHalCamera;     // The low level camera interface that backs this proxy
+                                            // (guarded by mAccessLock)
     sp<IEvsCameraStream>    mStream;
 
-    std::deque<BufferDesc>  mFramesHeld;
-    unsigned                mFramesAllowed  = 1;
-    enum {
+    // Frames accepted for the client but not yet sent.  Our own thread makes the calls into the
+    // client so a slow client can't hold up the frames going to the others.
+    StageQueue<BufferDesc>  mDeliveryQueue;
+    std::thread             mDeliveryThread;
+    std::atomic<unsigned>   mFramesOverflowed{0};   // Declined because the queue was full
+    unsigned                mFramesOverQuota = 0;   // Declined because the client held too many
+
+    // When the client asks for a lower rate than the camera runs at, frames are passed through
+    // at evenly spaced times and the rest are declined before any call to the client is made
+    unsigned                                mFrameRate = 0;    // Zero means every frame
+    std::chrono::steady_clock::duration     mFrameInterval{0};
+    std::chrono::steady_clock::time_point   mNextFrameTime;
+
+    // What happens to a frame which arrives while the client holds all it is allowed
+    // (see EXTENDED_INFO_CLIENT_DELIVERY_POLICY)
+    int32_t                 mDeliveryPolicy =
+            ::android::automotive::evs::support::DELIVERY_POLICY_DROP_NEWEST;
+    BufferDesc              mPendingFrame = {};     // The newest such frame, if latest wins
+    bool                    mHasPendingFrame = false;
+
+    FrameTable<BufferDesc>  mFramesHeld;    // Frames the client has yet to return, by bufferId
+
+    // Frames wait here for those of the other cameras in the group before going to the client
+    // (see EXTENDED_INFO_CLIENT_SYNC_GROUP)
+    std::shared_ptr<SyncGroup> mSyncGroup;
+
+    // These are read by our HalCamera without taking our lock
+    std::atomic<unsigned>   mFramesAllowed{1};
+    std::atomic<int32_t>    mFormat{0};     // See EXTENDED_INFO_CLIENT_FORMAT
+    enum StreamState {
         STOPPED,
         RUNNING,
         STOPPING,
-    }                       mStreamState    = STOPPED;
+    };
+    std::atomic<StreamState> mStreamState{STOPPED};
+
+    // Guards the frame bookkeeping and client settings above against the frame delivery thread.
+    // Never held while calling into the hardware in a way that could call back to us.
+    std::mutex              mAccessLock;
+
+    // Serializes changes to our buffer allowance with shutdown() giving it back, so our
+    // HalCamera's count of buffers needed always matches what we've asked for.  Taken before
+    // mAccessLock, and held while calling into our HalCamera.
+    std::mutex              mAllowanceLock;
 };
 
 } // namespace implementation
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <hidl/HidlTransportSupport.h>
@@ -38,6 +39,15 @@ using namespace android::automotive::evs::V1_0::implementation;
 using namespace android;
 
 
+// Binder threads serving our clients.  Enough that a slow call from one client (ie: opening a
+// camera) doesn't hold up the others.
+static const unsigned kDefaultThreadCount = 4;
+
+// How long a camera may go without delivering a frame before we restart its stream.  Long
+// enough for a slow camera's first frame, short enough that a stall isn't noticed by the driver.
+static const unsigned kDefaultWatchdogMs = 500;
+
+
 static void startService(const char *hardwareServiceName, const char * managerServiceName) {
     ALOGI("EVS managed service connecting to hardware service at %s", hardwareServiceName);
     android::sp<Enumerator> service = new Enumerator();
@@ -66,6 +76,8 @@ int main(int argc, char** argv) {
     // Set up default behavior, then check for command line options
     bool printHelp = false;
     const char* evsHardwareServiceName = kHardwareEnumeratorName;
+    unsigned threadCount = kDefaultThreadCount;
+    unsigned watchdogMs = kDefaultWatchdogMs;
     for (int i=1; i< argc; i++) {
         if (strcmp(argv[i], "--mock") == 0) {
             evsHardwareServiceName = kMockEnumeratorName;
@@ -76,6 +88,24 @@ int main(int argc, char** argv) {
             } else {
                 evsHardwareServiceName = argv[i];
             }
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--threads <count> was not provided with a thread count\n");
+            } else if (atoi(argv[i]) < 1) {
+                ALOGE("Ignoring --threads %s since at least one is required\n", argv[i]);
+            } else {
+                threadCount = atoi(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--watchdog") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--watchdog <ms> was not provided with a deadline\n");
+            } else if (atoi(argv[i]) < 0) {
+                ALOGE("Ignoring --watchdog %s since the deadline can't be negative\n", argv[i]);
+            } else {
+                watchdogMs = atoi(argv[i]);
+            }
         } else if (strcmp(argv[i], "--help") == 0) {
             printHelp = true;
         } else {
@@ -86,13 +116,23 @@ int main(int argc, char** argv) {
     if (printHelp) {
         printf("Options include:\n");
         printf("  --mock                   Connect to the mock driver at EvsEnumeratorHw-Mock\n");
-        printf("  --target <service_name>  Connect to the named IEvsEnumerator service");
+        printf("  --target <service_name>  Connect to the named IEvsEnumerator service\n");
+        printf("  --threads <count>        Binder threads serving clients (default %u)\n",
+               kDefaultThreadCount);
+        printf("  --watchdog <ms>          Restart a camera stream after this long without a frame\n"
+               "                           (default %u, 0 to disable)\n", kDefaultWatchdogMs);
+    }
+
+    if (watchdogMs > 0) {
+        ALOGI("Restarting camera streams that stall for %u ms", watchdogMs);
     }
+    HalCamera::setWatchdogDeadline(std::chrono::milliseconds(watchdogMs));
 
 
-    // Prepare the RPC serving thread pool.  We're configuring it with no additional
-    // threads beyond the main thread which will "join" the pool below.
-    configureRpcThreadpool(1, true /* callerWillJoin */);
+    // Prepare the RPC serving thread pool.  The main thread counts as one of them when it
+    // "joins" the pool below.
+    ALOGI("Serving clients with %u threads", threadCount);
+    configureRpcThreadpool(threadCount, true /* callerWillJoin */);
 
     // The connection to the underlying hardware service must happen on a dedicated thread to ensure
     // that the hwbinder response can be processed by the thread pool without blocking.
@@ -10,8 +10,16 @@ LOCAL_SRC_FILES := \
     EvsGlDisplay.cpp \
     GlWrapper.cpp \
     VideoCapture.cpp \
+    CaptureLoop.cpp \
     bufferCopy.cpp \
+    ConversionPool.cpp \
+    CaptureConfig.cpp \
 
+# SIMD pixel conversion kernels, chosen at runtime based on the CPU's capabilities
+LOCAL_SRC_FILES_arm    := bufferCopy_neon.cpp.neon
+LOCAL_SRC_FILES_arm64  := bufferCopy_neon.cpp
+LOCAL_SRC_FILES_x86    := bufferCopy_sse.cpp
+LOCAL_SRC_FILES_x86_64 := bufferCopy_sse.cpp
 
 LOCAL_SHARED_LIBRARIES := \
     android.hardware.automotive.evs@1.0 \
@@ -28,6 +36,10 @@ LOCAL_SHARED_LIBRARIES := \
     liblog \
     libutils \
 
+LOCAL_STATIC_LIBRARIES := \
+    libevssupport \
+    libjsoncpp \
+
 LOCAL_INIT_RC := android.hardware.automotive.evs@1.0-sample.rc
 
 LOCAL_MODULE := android.hardware.automotive.evs@1.0-sample
@@ -43,3 +55,17 @@ LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
 #LOCAL_CFLAGS += -O0 -g
 
 include $(BUILD_EXECUTABLE)
+
+
+##################################
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    FreeList_test.cpp \
+
+LOCAL_MODULE := evs_sample_driver_freelist_test
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CaptureConfig.h"
+
+#include <fstream>
+#include <cutils/log.h>
+
+#include "json/json.h"
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+CaptureRequest                          CaptureConfig::sDefaultRequest;
+std::map<std::string, CaptureRequest>   CaptureConfig::sCameraRequests;
+
+
+// V4L2 field orders by the names used for them in the configuration file
+static const std::map<std::string, __u32> kFieldNames = {
+    { "any",            V4L2_FIELD_ANY },
+    { "none",           V4L2_FIELD_NONE },
+    { "top",            V4L2_FIELD_TOP },
+    { "bottom",         V4L2_FIELD_BOTTOM },
+    { "interlaced",     V4L2_FIELD_INTERLACED },
+    { "seq_tb",         V4L2_FIELD_SEQ_TB },
+    { "seq_bt",         V4L2_FIELD_SEQ_BT },
+    { "alternate",      V4L2_FIELD_ALTERNATE },
+    { "interlaced_tb",  V4L2_FIELD_INTERLACED_TB },
+    { "interlaced_bt",  V4L2_FIELD_INTERLACED_BT },
+};
+
+
+// Fills in whichever fields the given record specifies, leaving the others alone
+static void readRequest(const Json::Value& node, CaptureRequest* request) {
+    const std::string format = node.get("format", "").asString();
+    if (format.size() == 4) {
+        request->format = v4l2_fourcc(format[0], format[1], format[2], format[3]);
+    } else if (!format.empty()) {
+        ALOGW("Ignoring capture format '%s' which isn't a four character code", format.c_str());
+    }
+
+    request->width  = node.get("width",  request->width).asUInt();
+    request->height = node.get("height", request->height).asUInt();
+    request->fps    = node.get("fps",    request->fps).asUInt();
+
+    const std::string field = node.get("field", "").asString();
+    auto it = kFieldNames.find(field);
+    if (it != kFieldNames.end()) {
+        request->field = it->second;
+    } else if (!field.empty()) {
+        ALOGW("Ignoring unknown field order '%s'", field.c_str());
+    }
+}
+
+
+bool CaptureConfig::load(const char* configFileName) {
+    std::ifstream configStream(configFileName);
+    if (!configStream.is_open()) {
+        ALOGI("No capture configuration at %s, using defaults", configFileName);
+        return true;
+    }
+
+    Json::Reader reader;
+    Json::Value rootNode;
+    if (!reader.parse(configStream, rootNode, false)) {
+        ALOGE("Failed to parse %s: %s",
+              configFileName, reader.getFormattedErrorMessages().c_str());
+        return false;
+    }
+
+    readRequest(rootNode["default"], &sDefaultRequest);
+
+    const Json::Value cameraArray = rootNode["cameras"];
+    for (auto&& node : cameraArray) {
+        const std::string cameraId = node.get("cameraId", "").asString();
+        if (cameraId.empty()) {
+            ALOGW("Ignoring camera record without a cameraId");
+            continue;
+        }
+
+        // Settings not given for the camera come from the defaults
+        CaptureRequest request = sDefaultRequest;
+        readRequest(node, &request);
+        sCameraRequests[cameraId] = request;
+    }
+
+    ALOGI("Loaded capture settings for %zu cameras from %s",
+          sCameraRequests.size(), configFileName);
+    return true;
+}
+
+
+CaptureRequest CaptureConfig::getRequest(const std::string& cameraId) {
+    auto it = sCameraRequests.find(cameraId);
+    if (it == sCameraRequests.end()) {
+        return sDefaultRequest;
+    }
+    return it->second;
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURECONFIG_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURECONFIG_H
+
+#include <map>
+#include <string>
+
+#include "VideoCapture.h"
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Per camera capture settings read from the driver's optional configuration file.
+// See capture_config.json.readme for the file format.
+class CaptureConfig {
+public:
+    // Returns false if the file exists but can't be parsed.  A missing file is not an error.
+    static bool load(const char* configFileName);
+
+    // The settings to use for the given camera, falling back to the file's defaults
+    static CaptureRequest getRequest(const std::string& cameraId);
+
+private:
+    static CaptureRequest                           sDefaultRequest;
+    static std::map<std::string, CaptureRequest>    sCameraRequests;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURECONFIG_H
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <cutils/log.h>
+
+#include "CaptureLoop.h"
+#include "VideoCapture.h"
+
+
+// How long we wait for a frame before checking our devices for stalls
+static const int kPollTimeoutMs = 100;
+
+// How many events we handle per wake up
+static const int kMaxEvents = 8;
+
+
+CaptureLoop::CaptureLoop() :
+        mStopping(false) {
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        ALOGE("epoll_create1: %s", strerror(errno));
+    }
+
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mWakeFd < 0) {
+        ALOGE("eventfd: %s", strerror(errno));
+    } else {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = mWakeFd;
+        epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event);
+    }
+
+    mThread = std::thread([this](){ run(); });
+}
+
+
+CaptureLoop::~CaptureLoop() {
+    mStopping = true;
+    wake();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    if (mWakeFd >= 0) {
+        ::close(mWakeFd);
+    }
+    if (mEpollFd >= 0) {
+        ::close(mEpollFd);
+    }
+}
+
+
+CaptureLoop& CaptureLoop::getShared() {
+    static CaptureLoop sLoop;
+    return sLoop;
+}
+
+
+bool CaptureLoop::addCapture(VideoCapture* capture) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = capture->mDeviceFd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, capture->mDeviceFd, &event) < 0) {
+        ALOGE("epoll_ctl(ADD): %s", strerror(errno));
+        return false;
+    }
+
+    mCaptures[capture->mDeviceFd] = capture;
+    return true;
+}
+
+
+void CaptureLoop::removeCapture(VideoCapture* capture) {
+    // Taking the lock waits for any frame being dispatched to finish
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto it = mCaptures.find(capture->mDeviceFd);
+    if (it != mCaptures.end() && it->second == capture) {
+        // This fails harmlessly if we already stopped watching the device after an error
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, capture->mDeviceFd, nullptr);
+        mCaptures.erase(it);
+    }
+}
+
+
+void CaptureLoop::wake() {
+    uint64_t one = 1;
+    if (write(mWakeFd, &one, sizeof(one)) < 0) {
+        ALOGE("Failed to wake capture loop: %s", strerror(errno));
+    }
+}
+
+
+void CaptureLoop::run() {
+    epoll_event events[kMaxEvents];
+
+    while (!mStopping) {
+        int count = epoll_wait(mEpollFd, events, kMaxEvents, kPollTimeoutMs);
+        if (count < 0) {
+            if (errno != EINTR) {
+                ALOGE("epoll_wait: %s", strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mLock);
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == mWakeFd) {
+                // We only needed to wake up, so just clear the signal
+                uint64_t value;
+                if (read(mWakeFd, &value, sizeof(value)) < 0) {
+                    ALOGW("Failed to clear capture loop wake signal: %s", strerror(errno));
+                }
+                continue;
+            }
+
+            // The capture may have been removed since epoll_wait returned
+            auto it = mCaptures.find(events[i].data.fd);
+            if (it == mCaptures.end()) {
+                continue;
+            }
+
+            if (!it->second->dequeueFrame()) {
+                // The device is in trouble or on its way out, so stop listening to it rather
+                // than spinning on it.  It stays in our list until removed, so the stall check
+                // keeps reporting a device in trouble.
+                epoll_ctl(mEpollFd, EPOLL_CTL_DEL, events[i].data.fd, nullptr);
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        for (auto&& entry : mCaptures) {
+            entry.second->checkForStall(now);
+        }
+    }
+
+    ALOGD("Capture loop ending");
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURELOOP_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURELOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+
+class VideoCapture;
+
+
+// A thread which waits on one or more streaming capture devices with epoll and dispatches each
+// frame as it arrives.  Each VideoCapture normally gets a loop of its own, but all of them can
+// share a single loop to save threads on systems with many cameras.
+class CaptureLoop {
+public:
+    CaptureLoop();
+    ~CaptureLoop();
+
+    // The loop shared by every camera when the shared capture thread is enabled
+    static CaptureLoop& getShared();
+
+    bool addCapture(VideoCapture* capture);
+
+    // Once this returns, the loop is not dispatching a frame from this capture and never will
+    void removeCapture(VideoCapture* capture);
+
+private:
+    void run();
+    void wake();
+
+    int mEpollFd = -1;
+    int mWakeFd  = -1;              // Written to get the loop's attention right away
+
+    std::thread         mThread;
+    std::atomic<bool>   mStopping;
+
+    // Held while dispatching, so removeCapture() can wait out a frame in progress
+    std::mutex                      mLock;
+    std::map<int, VideoCapture*>    mCaptures;      // Indexed by device file descriptor
+};
+
+#endif // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURELOOP_H
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConversionPool.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <cutils/log.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Bands smaller than this aren't worth the cost of waking another thread
+static const unsigned kMinBandRows = 32;
+
+// Used when configure() isn't called.  Leave one core for the capture and binder threads, and
+// don't take over a large machine.
+static const unsigned kMaxDefaultThreads = 3;
+
+
+unsigned ConversionPool::sThreadCount = ~0U;
+std::vector<int> ConversionPool::sCpus;
+
+
+void ConversionPool::configure(unsigned threadCount, const std::vector<int>& cpus) {
+    sThreadCount = threadCount;
+    sCpus = cpus;
+}
+
+
+ConversionPool& ConversionPool::get() {
+    static ConversionPool sPool([]() {
+        if (sThreadCount != ~0U) {
+            return sThreadCount;
+        }
+        unsigned cores = std::thread::hardware_concurrency();
+        return (cores > 1) ? std::min(cores - 1, kMaxDefaultThreads) : 0;
+    }(), sCpus);
+
+    return sPool;
+}
+
+
+ConversionPool::ConversionPool(unsigned threadCount, const std::vector<int>& cpus) {
+    ALOGI("Starting %u image conversion threads", threadCount);
+    for (unsigned i = 0; i < threadCount; i++) {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        mThreads.emplace_back([this, cpu]() { workerLoop(cpu); });
+    }
+}
+
+
+ConversionPool::~ConversionPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+
+    for (auto&& thread : mThreads) {
+        thread.join();
+    }
+}
+
+
+void ConversionPool::run(unsigned rowCount, unsigned rowAlignment, const BandFunction& work) {
+    if (rowAlignment < 1) {
+        rowAlignment = 1;
+    }
+
+    // One band per worker plus one for this thread, aligned so no band splits a group of rows
+    // the conversion has to treat as a unit (ie: the 2x2 cells of an NV21 image)
+    unsigned bandCount = mThreads.size() + 1;
+    unsigned bandRows = std::max((rowCount + bandCount - 1) / bandCount, kMinBandRows);
+    bandRows = (bandRows + rowAlignment - 1) / rowAlignment * rowAlignment;
+    bandCount = (rowCount + bandRows - 1) / bandRows;
+
+    if (bandCount <= 1) {
+        // Not worth splitting up, so don't bother the workers
+        work(0, rowCount);
+        return;
+    }
+
+    Job job = {};
+    job.work      = &work;
+    job.rowCount  = rowCount;
+    job.bandRows  = bandRows;
+    job.bandCount = bandCount;
+
+    std::unique_lock<std::mutex> lock(mLock);
+    mJobs.push_back(&job);
+    mWorkAvailable.notify_all();
+
+    // Help out with our own job rather than sitting idle
+    while (runNextBand_Locked(&job, lock)) {
+    }
+
+    // Wait for the bands the workers picked up before the caller is allowed to touch the image
+    mBandDone.wait(lock, [&job]() { return job.bandsDone == job.bandCount; });
+}
+
+
+// Claims and runs one band of the given job, dropping the lock while the band runs.  Returns
+// false if every band of the job has already been claimed.
+bool ConversionPool::runNextBand_Locked(Job* job, std::unique_lock<std::mutex>& lock) {
+    if (job->nextBand >= job->bandCount) {
+        return false;
+    }
+
+    unsigned band = job->nextBand++;
+    if (job->nextBand == job->bandCount) {
+        // Nothing left for anyone else to pick up
+        for (auto it = mJobs.begin(); it != mJobs.end(); ++it) {
+            if (*it == job) {
+                mJobs.erase(it);
+                break;
+            }
+        }
+    }
+
+    unsigned firstRow = band * job->bandRows;
+    unsigned endRow = std::min(firstRow + job->bandRows, job->rowCount);
+
+    lock.unlock();
+    (*job->work)(firstRow, endRow);
+    lock.lock();
+
+    // The job can't be released by its owner until this count is complete
+    job->bandsDone++;
+    if (job->bandsDone == job->bandCount) {
+        mBandDone.notify_all();
+    }
+
+    return true;
+}
+
+
+void ConversionPool::workerLoop(int cpu) {
+    if (cpu >= 0) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+            ALOGW("Failed to pin conversion thread to cpu %d (%s)", cpu, strerror(errno));
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mStopping) {
+        if (mJobs.empty()) {
+            mWorkAvailable.wait(lock);
+        } else {
+            runNextBand_Locked(mJobs.front(), lock);
+        }
+    }
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CONVERSIONPOOL_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CONVERSIONPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// A set of worker threads shared by all cameras which splits an image conversion into bands of
+// rows and runs them in parallel.  The calling thread converts one band itself, so a pool
+// configured with no worker threads simply runs the whole frame inline.
+class ConversionPool {
+public:
+    // Called on each band with the half open range of image rows [firstRow, endRow) to process
+    typedef std::function<void(unsigned firstRow, unsigned endRow)> BandFunction;
+
+    // Must be called before the first call to get().  An empty cpu list leaves the workers
+    // free to run anywhere; otherwise worker N is pinned to cpus[N % cpus.size()].
+    static void configure(unsigned threadCount, const std::vector<int>& cpus);
+
+    // Returns the process wide pool, starting its threads on first use
+    static ConversionPool& get();
+
+    // Splits rowCount rows into bands whose boundaries fall on multiples of rowAlignment and
+    // blocks until every band has been processed.  Safe to call from several threads at once.
+    void run(unsigned rowCount, unsigned rowAlignment, const BandFunction& work);
+
+    unsigned getThreadCount() const { return mThreads.size(); };
+
+    ~ConversionPool();
+
+private:
+    // One call to run() in progress.  Lives on the caller's stack and is guarded by mLock.
+    struct Job {
+        const BandFunction* work;
+        unsigned rowCount;
+        unsigned bandRows;
+        unsigned bandCount;
+        unsigned nextBand;      // The next band not yet claimed by any thread
+        unsigned bandsDone;     // How many bands have finished running
+    };
+
+    ConversionPool(unsigned threadCount, const std::vector<int>& cpus);
+
+    void workerLoop(int cpu);
+    bool runNextBand_Locked(Job* job, std::unique_lock<std::mutex>& lock);
+
+    std::vector<std::thread> mThreads;
+
+    std::mutex              mLock;
+    std::condition_variable mWorkAvailable;     // Signaled when a job is queued or on shutdown
+    std::condition_variable mBandDone;          // Signaled when a job's final band completes
+    std::deque<Job*>        mJobs;              // Jobs with bands not yet claimed
+    bool                    mStopping = false;
+
+    static unsigned         sThreadCount;
+    static std::vector<int> sCpus;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CONVERSIONPOOL_H
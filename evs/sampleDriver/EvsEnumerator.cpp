@@ -251,6 +251,7 @@ bool EvsEnumerator::qualifyCaptureDevice(const char* deviceName) {
             switch (formatDescription.pixelformat)
             {
                 case V4L2_PIX_FMT_YUYV:     return true;
+                case V4L2_PIX_FMT_UYVY:     return true;
                 case V4L2_PIX_FMT_NV21:     return true;
                 case V4L2_PIX_FMT_NV16:     return true;
                 case V4L2_PIX_FMT_YVU420:   return true;
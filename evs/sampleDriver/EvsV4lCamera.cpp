@@ -17,10 +17,17 @@
 #include "EvsV4lCamera.h"
 #include "EvsEnumerator.h"
 #include "bufferCopy.h"
+#include "EvsExtendedInfo.h"
+#include "ConversionPool.h"
+#include "CaptureConfig.h"
+#include "BufferSync.h"
 
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 
+#include <chrono>
+#include <linux/dma-buf.h>
+
 
 namespace android {
 namespace hardware {
@@ -30,11 +37,48 @@ namespace V1_0 {
 namespace implementation {
 
 
+using ::android::automotive::evs::support::ColorMatrix;
+using ::android::automotive::evs::support::ColorRange;
+using ::android::automotive::evs::support::COLOR_MATRIX_BT601;
+using ::android::automotive::evs::support::COLOR_MATRIX_BT709;
+using ::android::automotive::evs::support::COLOR_RANGE_LIMITED;
+using ::android::automotive::evs::support::COLOR_RANGE_FULL;
+using ::android::automotive::evs::support::EXTENDED_INFO_COLOR_MATRIX;
+using ::android::automotive::evs::support::EXTENDED_INFO_COLOR_RANGE;
+using ::android::automotive::evs::support::EXTENDED_INFO_CONVERT_QUEUED;
+using ::android::automotive::evs::support::EXTENDED_INFO_CONVERT_PEAK;
+using ::android::automotive::evs::support::EXTENDED_INFO_DELIVER_QUEUED;
+using ::android::automotive::evs::support::EXTENDED_INFO_DELIVER_PEAK;
+using ::android::automotive::evs::support::EXTENDED_INFO_FRAMES_DROPPED;
+using ::android::automotive::evs::support::EXTENDED_INFO_CONVERT_TIME_US;
+using ::android::automotive::evs::support::syncCpuWrite;
+
+
 // Arbitrary limit on number of graphics buffers allowed to be allocated
 // Safeguards against unreasonable resource consumption and provides a testable limit
 static const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
 
 
+bool EvsV4lCamera::sZeroCopyAllowed = true;
+bool EvsV4lCamera::sPersistentMapping = true;
+
+
+// The camera formats we can turn into each output format, cheapest conversion first.
+// These must stay in step with the fill functions chosen in startVideoStream().
+static std::vector<__u32> getSourceFormats(uint32_t outputFormat) {
+    switch (outputFormat) {
+    case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+        return { V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_YUYV };
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+        return { V4L2_PIX_FMT_YUYV };
+    case HAL_PIXEL_FORMAT_YCBCR_422_I:
+        return { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY };
+    default:
+        return {};
+    }
+}
+
+
 EvsV4lCamera::EvsV4lCamera(const char *deviceName) :
         mFramesAllowed(0),
         mFramesInUse(0) {
@@ -42,11 +86,6 @@ EvsV4lCamera::EvsV4lCamera(const char *deviceName) :
 
     mDescription.cameraId = deviceName;
 
-    // Initialize the video device
-    if (!mVideo.open(deviceName)) {
-        ALOGE("Failed to open v4l device %s\n", deviceName);
-    }
-
     // NOTE:  Our current spec says only support NV21 -- can we stick to that with software
     // conversion?  Will this work with the hardware texture units?
     // TODO:  Settle on the one official format that works on all platforms
@@ -55,10 +94,21 @@ EvsV4lCamera::EvsV4lCamera(const char *deviceName) :
 //    mFormat = HAL_PIXEL_FORMAT_RGBA_8888;
     mFormat = HAL_PIXEL_FORMAT_YCBCR_422_I;
 
+    // Initialize the video device, letting it pick the camera format that's cheapest to turn
+    // into our output format unless the configuration says otherwise
+    if (!mVideo.open(deviceName, CaptureConfig::getRequest(deviceName),
+                     getSourceFormats(mFormat))) {
+        ALOGE("Failed to open v4l device %s\n", deviceName);
+    }
+
     // How we expect to use the gralloc buffers we'll exchange with our client
     mUsage  = GRALLOC_USAGE_HW_TEXTURE     |
               GRALLOC_USAGE_SW_READ_RARELY |
               GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+    // Until told otherwise, assume the camera follows the usual convention for its resolution
+    mColorConverter = std::make_shared<ColorConverter>(
+            ColorConverter::defaultMatrixForHeight(mVideo.getHeight()), COLOR_RANGE_LIMITED);
 }
 
 
@@ -85,17 +135,18 @@ void EvsV4lCamera::shutdown()
     mVideo.close();
 
     // Drop all the graphics buffers we've been using
+    std::lock_guard<std::mutex> lock(mAccessLock);
     if (mBuffers.size() > 0) {
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        for (auto&& rec : mBuffers) {
-            if (rec.inUse) {
+        for (unsigned idx = 0; idx < mBuffers.size(); idx++) {
+            if (mBuffers[idx].inUse) {
                 ALOGW("Error - releasing buffer despite remote ownership");
             }
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+            freeBuffer_Locked(idx);
         }
         mBuffers.clear();
     }
+    mIdleSlots.clear();
+    mEmptySlots.clear();
 }
 
 
@@ -203,15 +254,45 @@ Return<EvsResult> EvsV4lCamera::startVideoStream(const ::android::sp<IEvsCameraS
     }
 
 
+    // If the device can produce frames in exactly the layout of our output buffers, skip the
+    // copy entirely and have it capture straight into them
+    mZeroCopy = false;
+    if (canZeroCopy_Locked() && mVideo.useDmabuf(MAX_BUFFERS_IN_FLIGHT)) {
+        ALOGI("Using zero copy capture");
+        mZeroCopy = true;
+
+        // Any the device can't take go back on the idle list, so take them all off it first
+        std::vector<unsigned> idleSlots;
+        unsigned idx = 0;
+        while (mIdleSlots.acquire(&idx)) {
+            idleSlots.push_back(idx);
+        }
+        for (unsigned slot : idleSlots) {
+            queueZeroCopyBuffer_Locked(slot);
+        }
+    }
+
     // Record the user's callback for use when we have a frame ready
     mStream = stream;
 
+    // The conversion and delivery stages have to be ready before the first frame arrives
+    startPipeline();
+
     // Set up the video stream with a callback to our member function forwardFrame()
     if (!mVideo.startStream([this](VideoCapture*, imageBuffer* tgt, void* data) {
                                 this->forwardFrame(tgt, data);
                             })
     ) {
+        mConvertQueue.close();
+        mDeliverQueue.close();
+        mConvertThread.join();
+        mDeliverThread.join();
         mStream = nullptr;  // No need to hold onto this if we failed to start
+        mZeroCopy = false;
+        for (auto&& rec : mBuffers) {
+            rec.queued = false;
+        }
+        rebuildFreeLists_Locked();
         ALOGE("underlying camera start stream failed");
         return EvsResult::UNDERLYING_SERVICE_ERROR;
     }
@@ -238,21 +319,7 @@ Return<void> EvsV4lCamera::doneWithFrame(const BufferDesc& buffer)  {
                   buffer.bufferId);
         } else {
             // Mark the frame as available
-            mBuffers[buffer.bufferId].inUse = false;
-            mFramesInUse--;
-
-            // If this frame's index is high in the array, try to move it down
-            // to improve locality after mFramesAllowed has been reduced.
-            if (buffer.bufferId >= mFramesAllowed) {
-                // Find an empty slot lower in the array (which should always exist in this case)
-                for (auto&& rec : mBuffers) {
-                    if (rec.handle == nullptr) {
-                        rec.handle = mBuffers[buffer.bufferId].handle;
-                        mBuffers[buffer.bufferId].handle = nullptr;
-                        break;
-                    }
-                }
-            }
+            returnBuffer_Locked(buffer.bufferId);
         }
     }
 
@@ -263,9 +330,38 @@ Return<void> EvsV4lCamera::doneWithFrame(const BufferDesc& buffer)  {
 Return<void> EvsV4lCamera::stopVideoStream()  {
     ALOGD("stopVideoStream");
 
+    // Finish any conversions first since they read from the capture buffers, which stopping
+    // the device releases.  Frames captured from here on are dropped.
+    const bool wasStreaming = mConvertThread.joinable();
+    mConvertQueue.close();
+    if (wasStreaming) {
+        mConvertThread.join();
+    }
+
     // Tell the capture device to stop (and block until it does)
     mVideo.stopStream();
 
+    // Stopping the device took back any buffers it was holding
+    {
+        std::lock_guard <std::mutex> lock(mAccessLock);
+        mZeroCopy = false;
+        for (auto&& rec : mBuffers) {
+            rec.queued = false;
+        }
+        rebuildFreeLists_Locked();
+    }
+
+    // Deliver whatever frames are still on their way to the client
+    mDeliverQueue.close();
+    if (mDeliverThread.joinable()) {
+        mDeliverThread.join();
+    }
+
+    if (wasStreaming && mFramesConverted > 0) {
+        ALOGI("Converted %u frames in an average of %u us each",
+              mFramesConverted.load(), averageConvertMicroseconds());
+    }
+
     if (mStream != nullptr) {
         std::unique_lock <std::mutex> lock(mAccessLock);
 
@@ -284,15 +380,30 @@ Return<void> EvsV4lCamera::stopVideoStream()  {
 }
 
 
-Return<int32_t> EvsV4lCamera::getExtendedInfo(uint32_t /*opaqueIdentifier*/)  {
+Return<int32_t> EvsV4lCamera::getExtendedInfo(uint32_t opaqueIdentifier)  {
     ALOGD("getExtendedInfo");
-    // Return zero by default as required by the spec
-    return 0;
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    switch (opaqueIdentifier) {
+    case EXTENDED_INFO_COLOR_MATRIX:    return mColorConverter->getMatrix();
+    case EXTENDED_INFO_COLOR_RANGE:     return mColorConverter->getRange();
+    case EXTENDED_INFO_CONVERT_QUEUED:  return mConvertQueue.size();
+    case EXTENDED_INFO_CONVERT_PEAK:    return mConvertQueue.highWater();
+    case EXTENDED_INFO_DELIVER_QUEUED:  return mDeliverQueue.size();
+    case EXTENDED_INFO_DELIVER_PEAK:    return mDeliverQueue.highWater();
+    case EXTENDED_INFO_FRAMES_DROPPED:
+        return mFramesSkipped + mConvertQueue.dropped() + mDeliverQueue.dropped();
+    case EXTENDED_INFO_CONVERT_TIME_US:
+        return averageConvertMicroseconds();
+    default:
+        // Return zero by default as required by the spec
+        return 0;
+    }
 }
 
 
-Return<EvsResult> EvsV4lCamera::setExtendedInfo(uint32_t /*opaqueIdentifier*/,
-                                                int32_t /*opaqueValue*/)  {
+Return<EvsResult> EvsV4lCamera::setExtendedInfo(uint32_t opaqueIdentifier,
+                                                int32_t opaqueValue)  {
     ALOGD("setExtendedInfo");
     std::lock_guard<std::mutex> lock(mAccessLock);
 
@@ -302,8 +413,30 @@ Return<EvsResult> EvsV4lCamera::setExtendedInfo(uint32_t /*opaqueIdentifier*/,
         return EvsResult::OWNERSHIP_LOST;
     }
 
-    // We don't store any device specific information in this implementation
-    return EvsResult::INVALID_ARG;
+    ColorMatrix matrix = mColorConverter->getMatrix();
+    ColorRange range = mColorConverter->getRange();
+    switch (opaqueIdentifier) {
+    case EXTENDED_INFO_COLOR_MATRIX:
+        if (opaqueValue != COLOR_MATRIX_BT601 && opaqueValue != COLOR_MATRIX_BT709) {
+            return EvsResult::INVALID_ARG;
+        }
+        matrix = static_cast<ColorMatrix>(opaqueValue);
+        break;
+    case EXTENDED_INFO_COLOR_RANGE:
+        if (opaqueValue != COLOR_RANGE_LIMITED && opaqueValue != COLOR_RANGE_FULL) {
+            return EvsResult::INVALID_ARG;
+        }
+        range = static_cast<ColorRange>(opaqueValue);
+        break;
+    default:
+        // We don't store any other device specific information in this implementation
+        return EvsResult::INVALID_ARG;
+    }
+
+    // Build the new tables off to the side so a frame being converted right now isn't disturbed
+    ALOGI("Using color matrix %d with range %d", matrix, range);
+    mColorConverter = std::make_shared<ColorConverter>(matrix, range);
+    return EvsResult::OK;
 }
 
 
@@ -383,21 +516,24 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
         }
 
         // Find a place to store the new buffer
-        bool stored = false;
-        for (auto&& rec : mBuffers) {
-            if (rec.handle == nullptr) {
-                // Use this existing entry
-                rec.handle = memHandle;
-                rec.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-        if (!stored) {
+        unsigned idx = 0;
+        if (mEmptySlots.acquire(&idx)) {
+            // Use this existing entry
+            mBuffers[idx].handle = memHandle;
+            mBuffers[idx].inUse = false;
+        } else {
             // Add a BufferRecord wrapping this handle to our set of available buffers
+            idx = mBuffers.size();
             mBuffers.emplace_back(memHandle);
         }
 
+        // While streaming in zero copy mode, the new buffer is immediately available to capture
+        if (mZeroCopy) {
+            queueZeroCopyBuffer_Locked(idx);
+        } else {
+            mIdleSlots.release(idx);
+        }
+
         mFramesAllowed++;
         added++;
     }
@@ -407,24 +543,29 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
 
 
 unsigned EvsV4lCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
-    // Acquire the graphics buffer allocator
-    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
-
     unsigned removed = 0;
 
-    for (auto&& rec : mBuffers) {
-        // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
-            // Release buffer and update the record so we can recognize it as "empty"
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+    // Idle buffers can go right away
+    unsigned idx = 0;
+    while (removed < numToRemove && mIdleSlots.acquire(&idx)) {
+        // Release buffer and update the record so we can recognize it as "empty"
+        freeBuffer_Locked(idx);
+        mEmptySlots.release(idx);
+
+        mFramesAllowed--;
+        removed++;
+    }
+
+    // In zero copy mode the capture device holds the buffers which aren't out with the client.
+    // Freeing them is okay since it keeps its own reference to the memory, and we'll drop the
+    // frame when it comes back.  The slot stays busy until then.
+    for (idx = 0; idx < mBuffers.size() && removed < numToRemove; idx++) {
+        BufferRecord& rec = mBuffers[idx];
+        if (!rec.inUse && rec.queued && rec.handle != nullptr) {
+            freeBuffer_Locked(idx);
 
             mFramesAllowed--;
             removed++;
-
-            if (removed == numToRemove) {
-                break;
-            }
         }
     }
 
@@ -432,10 +573,36 @@ unsigned EvsV4lCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
 }
 
 
-// This is the async callback from the video camera that tells us a frame is ready
-void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
+// Drops the buffer in the given slot, along with its CPU mapping
+void EvsV4lCamera::freeBuffer_Locked(unsigned idx) {
+    BufferRecord& rec = mBuffers[idx];
+    if (rec.handle == nullptr) {
+        return;
+    }
+
+    if (rec.pixels != nullptr) {
+        GraphicBufferMapper::get().unlock(rec.handle);
+        rec.pixels = nullptr;
+    }
+    GraphicBufferAllocator::get().free(rec.handle);
+    rec.handle = nullptr;
+}
+
+
+// This is the async callback from the video camera that tells us a frame is ready.  It runs on
+// the capture thread, so it only claims an output buffer and hands the frame to the conversion
+// stage.  It never waits, so the next frame can be dequeued as soon as it arrives.
+void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
+    if (mZeroCopy) {
+        // The image is already in one of our buffers
+        forwardZeroCopyFrame(pV4lBuff);
+        return;
+    }
+
     bool readyForFrame = false;
-    size_t idx = 0;
+    ConvertJob job = {};
+    job.v4lBuff = pV4lBuff;
+    job.data    = pData;
 
     // Lock scope for updating shared state
     {
@@ -445,17 +612,11 @@ void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
         if (mFramesInUse >= mFramesAllowed) {
             // Can't do anything right now -- skip this frame
             ALOGW("Skipped a frame because too many are in flight\n");
+            mFramesSkipped++;
         } else {
             // Identify an available buffer to fill
-            for (idx = 0; idx < mBuffers.size(); idx++) {
-                if (!mBuffers[idx].inUse) {
-                    if (mBuffers[idx].handle != nullptr) {
-                        // Found an available record, so stop looking
-                        break;
-                    }
-                }
-            }
-            if (idx >= mBuffers.size()) {
+            unsigned idx = 0;
+            if (!mIdleSlots.acquire(&idx)) {
                 // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
                 ALOGE("Failed to find an available buffer slot\n");
             } else {
@@ -463,49 +624,113 @@ void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
                 mBuffers[idx].inUse = true;
                 mFramesInUse++;
                 readyForFrame = true;
+                job.bufferId  = idx;
+                job.handle    = mBuffers[idx].handle;
+                job.pixels    = mBuffers[idx].pixels;
+                job.converter = mColorConverter;
             }
         }
     }
 
     if (!readyForFrame) {
         // We need to return the vide buffer so it can capture a new frame
-        mVideo.markFrameConsumed();
-    } else {
-        // Assemble the buffer description we'll transmit below
+        mVideo.markFrameConsumed(pV4lBuff);
+    } else if (!mConvertQueue.tryPush(job)) {
+        // Conversion is falling behind (or we're shutting down), so drop this frame
+        ALOGW("Skipped a frame because conversion is behind\n");
+        mVideo.markFrameConsumed(pV4lBuff);
+        releaseFrame(job.bufferId);
+    }
+}
+
+
+// The conversion stage.  Runs on its own thread, turning captured frames into output buffers.
+void EvsV4lCamera::convertFrames() {
+    ConvertJob job;
+    while (mConvertQueue.pop(&job)) {
+        const auto startTime = std::chrono::steady_clock::now();
+        const unsigned width  = mVideo.getWidth();
+        const unsigned height = mVideo.getHeight();
+
+        // Assemble the description of the buffer we're filling
         BufferDesc buff = {};
-        buff.width      = mVideo.getWidth();
-        buff.height     = mVideo.getHeight();
+        buff.width      = width;
+        buff.height     = height;
         buff.stride     = mStride;
         buff.format     = mFormat;
         buff.usage      = mUsage;
-        buff.bufferId   = idx;
-        buff.memHandle  = mBuffers[idx].handle;
+        buff.bufferId   = job.bufferId;
 
-        // Lock our output buffer for writing
-        void *targetPixels = nullptr;
+        // Lock our output buffer for writing.  A persistently mapped buffer is only locked the
+        // first time it is filled.
+        void *targetPixels = job.pixels;
         GraphicBufferMapper &mapper = GraphicBufferMapper::get();
-        mapper.lock(buff.memHandle,
-                    GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
-                    android::Rect(buff.width, buff.height),
-                    (void **) &targetPixels);
-
-        // If we failed to lock the pixel buffer, we're about to crash, but log it first
         if (!targetPixels) {
-            ALOGE("Camera failed to gain access to image buffer for writing");
+            mapper.lock(job.handle,
+                        GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                        android::Rect(width, height),
+                        (void **) &targetPixels);
+
+            // If we failed to lock the pixel buffer, we're about to crash, but log it first
+            if (!targetPixels) {
+                ALOGE("Camera failed to gain access to image buffer for writing");
+            } else if (sPersistentMapping) {
+                std::lock_guard<std::mutex> lock(mAccessLock);
+                mBuffers[job.bufferId].pixels = targetPixels;
+            }
+        }
+        if (sPersistentMapping) {
+            syncCpuWrite(job.handle, DMA_BUF_SYNC_START);
         }
 
         // Transfer the video image into the output buffer, making any needed
-        // format conversion along the way
-        mFillBufferFromVideo(buff, (uint8_t*)targetPixels, pData, mVideo.getStride());
-
-        // Unlock the output buffer
-        mapper.unlock(buff.memHandle);
+        // format conversion along the way.  The work is split into bands of rows spread across
+        // the conversion threads, and is complete for the whole frame when run() returns.
+        // Bands are kept to an even number of rows so NV21 2x2 cells are never split.
+        const unsigned srcStride = mVideo.getStride();
+        ConversionPool::get().run(height, 2,
+                                  [&](unsigned firstRow, unsigned endRow) {
+                                      mFillBufferFromVideo(buff, (uint8_t*)targetPixels, job.data,
+                                                           srcStride, *job.converter,
+                                                           firstRow, endRow);
+                                  });
+
+        // Unlock the output buffer, or just flush our writes if we're keeping it mapped
+        if (sPersistentMapping) {
+            syncCpuWrite(job.handle, DMA_BUF_SYNC_END);
+        } else {
+            mapper.unlock(job.handle);
+        }
 
+        mConvertNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - startTime).count();
+        mFramesConverted++;
 
         // Give the video frame back to the underlying device for reuse
         // Note that we do this before making the client callback to give the underlying
         // camera more time to capture the next frame.
-        mVideo.markFrameConsumed();
+        mVideo.markFrameConsumed(job.v4lBuff);
+
+        // Wait for room rather than drop a frame we've already paid to convert
+        if (!mDeliverQueue.push({ job.bufferId, job.handle })) {
+            releaseFrame(job.bufferId);
+        }
+    }
+}
+
+
+// The delivery stage.  Runs on its own thread so a slow client can't hold up capture.
+void EvsV4lCamera::deliverFrames() {
+    DeliverJob job;
+    while (mDeliverQueue.pop(&job)) {
+        BufferDesc buff = {};
+        buff.width      = mVideo.getWidth();
+        buff.height     = mVideo.getHeight();
+        buff.stride     = mStride;
+        buff.format     = mFormat;
+        buff.usage      = mUsage;
+        buff.bufferId   = job.bufferId;
+        buff.memHandle  = job.handle;
 
         // Issue the (asynchronous) callback to the client -- can't be holding the lock
         auto result = mStream->deliverFrame(buff);
@@ -519,10 +744,163 @@ void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
             ALOGE("Frame delivery call failed in the transport layer.");
 
             // Since we didn't actually deliver it, mark the frame as available
-            std::lock_guard<std::mutex> lock(mAccessLock);
-            mBuffers[idx].inUse = false;
-            mFramesInUse--;
+            releaseFrame(job.bufferId);
+        }
+    }
+}
+
+
+// Returns a frame which never made it to the client to the pool of available buffers
+void EvsV4lCamera::releaseFrame(unsigned idx) {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    returnBuffer_Locked(idx);
+}
+
+
+// Makes a buffer which was out for filling or with the client available again
+void EvsV4lCamera::returnBuffer_Locked(unsigned idx) {
+    mBuffers[idx].inUse = false;
+    mFramesInUse--;
+
+    if (mZeroCopy) {
+        // The buffer goes straight back to the device to be filled again
+        queueZeroCopyBuffer_Locked(idx);
+    } else {
+        mIdleSlots.release(idx);
+    }
+}
+
+
+// Sorts out which slots are free after a change which touches many of them at once (ie: the
+// capture device giving back every buffer it held when it stops)
+void EvsV4lCamera::rebuildFreeLists_Locked() {
+    mIdleSlots.clear();
+    mEmptySlots.clear();
+    for (unsigned idx = 0; idx < mBuffers.size(); idx++) {
+        const BufferRecord& rec = mBuffers[idx];
+        if (rec.inUse || rec.queued) {
+            continue;
         }
+        if (rec.handle != nullptr) {
+            mIdleSlots.release(idx);
+        } else {
+            mEmptySlots.release(idx);
+        }
+    }
+}
+
+
+unsigned EvsV4lCamera::averageConvertMicroseconds() {
+    unsigned frames = mFramesConverted;
+    return frames ? unsigned(mConvertNanoseconds / frames / 1000) : 0;
+}
+
+
+void EvsV4lCamera::startPipeline() {
+    mConvertQueue.reopen();
+    mDeliverQueue.reopen();
+    mFramesSkipped = 0;
+    mConvertNanoseconds = 0;
+    mFramesConverted = 0;
+    mConvertThread = std::thread([this](){ convertFrames(); });
+    mDeliverThread = std::thread([this](){ deliverFrames(); });
+}
+
+
+bool EvsV4lCamera::canZeroCopy_Locked() {
+    if (!sZeroCopyAllowed) {
+        return false;
+    }
+
+    // The device has to write exactly the pixel layout our clients expect in the output buffers
+    const uint32_t videoSrcFormat = mVideo.getV4LFormat();
+    unsigned bufferRowBytes = 0;
+    switch (mFormat) {
+    case HAL_PIXEL_FORMAT_YCBCR_422_I:
+        if (videoSrcFormat != V4L2_PIX_FMT_YUYV) {
+            return false;
+        }
+        bufferRowBytes = mStride * 2;
+        break;
+    case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+        if (videoSrcFormat != V4L2_PIX_FMT_NV21) {
+            return false;
+        }
+        bufferRowBytes = mStride;
+        break;
+    default:
+        // Anything else needs a conversion
+        return false;
+    }
+    if (mVideo.getStride() != bufferRowBytes) {
+        ALOGI("Can't use zero copy capture because camera rows are %u bytes, buffer rows are %u",
+              mVideo.getStride(), bufferRowBytes);
+        return false;
+    }
+
+    // We hand the device the first file descriptor in each buffer handle, which gralloc
+    // implementations conventionally use for the dmabuf holding the pixels
+    for (auto&& rec : mBuffers) {
+        if (rec.handle != nullptr && rec.handle->numFds < 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// A buffer the device won't take sits on the idle list, where a cut in the buffer count can
+// still find it, until the stream stops
+void EvsV4lCamera::queueZeroCopyBuffer_Locked(unsigned idx) {
+    if (idx >= mVideo.getDmabufCount()) {
+        // The device gave us fewer slots than we have buffers
+        ALOGW("Buffer %u is beyond the %u capture slots available", idx, mVideo.getDmabufCount());
+        mIdleSlots.release(idx);
+        return;
+    }
+
+    if (mVideo.queueDmabuf(idx, mBuffers[idx].handle->data[0])) {
+        mBuffers[idx].queued = true;
+    } else {
+        mIdleSlots.release(idx);
+    }
+}
+
+
+// Called in place of the conversion in forwardFrame when the device captured into our buffer
+void EvsV4lCamera::forwardZeroCopyFrame(imageBuffer* pV4lBuff) {
+    const unsigned idx = pV4lBuff->index;
+    DeliverJob job = {};
+
+    // Lock scope for updating shared state
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        if (idx >= mBuffers.size() || !mBuffers[idx].queued) {
+            ALOGE("Capture device returned unexpected buffer %u", idx);
+            return;
+        }
+        mBuffers[idx].queued = false;
+
+        if (mBuffers[idx].handle == nullptr) {
+            // We released this buffer while the device was holding it, so just let it go
+            mEmptySlots.release(idx);
+            return;
+        }
+
+        // We're going to make the frame busy
+        mBuffers[idx].inUse = true;
+        mFramesInUse++;
+
+        job.bufferId = idx;
+        job.handle   = mBuffers[idx].handle;
+    }
+
+    // There's nothing to convert, so go straight to delivery
+    if (!mDeliverQueue.tryPush(job)) {
+        ALOGW("Skipped a frame because delivery is behind\n");
+        releaseFrame(idx);
     }
 }
 
@@ -21,10 +21,15 @@
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 #include <ui/GraphicBuffer.h>
 
+#include <atomic>
 #include <thread>
 #include <functional>
+#include <memory>
 
 #include "VideoCapture.h"
+#include "ColorConvert.h"
+#include "StageQueue.h"
+#include "FreeList.h"
 
 
 namespace android {
@@ -35,6 +40,10 @@ namespace V1_0 {
 namespace implementation {
 
 
+using ::android::automotive::evs::support::ColorConverter;
+using ::android::automotive::evs::support::StageQueue;
+
+
 // From EvsEnumerator.h
 class EvsEnumerator;
 
@@ -57,13 +66,36 @@ public:
 
     const CameraDesc& getDesc() { return mDescription; };
 
+    // When allowed (the default), cameras whose capture format matches the output format have
+    // the device write straight into the gralloc buffers we hand to the client
+    static void setZeroCopyAllowed(bool allowed) { sZeroCopyAllowed = allowed; };
+
+    // When set (the default), each output buffer is mapped for CPU access once and stays mapped
+    // until it is freed, instead of being locked and unlocked around every frame
+    static void setPersistentMapping(bool persistent) { sPersistentMapping = persistent; };
+
 private:
     // These three functions are expected to be called while mAccessLock is held
     bool setAvailableFrames_Locked(unsigned bufferCount);
     unsigned increaseAvailableFrames_Locked(unsigned numToAdd);
     unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
+    void returnBuffer_Locked(unsigned idx);
+    void rebuildFreeLists_Locked();
+    void freeBuffer_Locked(unsigned idx);
 
+    // Frames pass from the capture thread (forwardFrame) through the conversion thread to the
+    // delivery thread, so each stage can work on a different frame at the same time
     void forwardFrame(imageBuffer* tgt, void* data);
+    void convertFrames();
+    void deliverFrames();
+    void releaseFrame(unsigned idx);
+    void startPipeline();
+    unsigned averageConvertMicroseconds();
+
+    // Support for capturing directly into our gralloc buffers via DMABUF import
+    bool canZeroCopy_Locked();
+    void queueZeroCopyBuffer_Locked(unsigned idx);
+    void forwardZeroCopyFrame(imageBuffer* pV4lBuff);
 
     sp <IEvsCameraStream> mStream = nullptr;  // The callback used to deliver each frame
 
@@ -76,18 +108,66 @@ private:
 
     struct BufferRecord {
         buffer_handle_t handle;
+        void* pixels;   // CPU mapping kept while the buffer exists (see setPersistentMapping)
         bool inUse;
+        bool queued;    // Held by the capture device in zero copy mode
 
-        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false) {};
+        explicit BufferRecord(buffer_handle_t h) :
+                handle(h), pixels(nullptr), inUse(false), queued(false) {};
     };
 
     std::vector <BufferRecord> mBuffers;    // Graphics buffers to transfer images
+
+    // Indices into mBuffers, so no frame has to search for a slot.  A buffer keeps its index
+    // (which is also its bufferId) for as long as it exists.
+    FreeList mIdleSlots;    // Holding a buffer ready to be filled (in zero copy mode, one the
+                            // capture device wouldn't take)
+    FreeList mEmptySlots;   // Holding no buffer, and not held by the capture device
+
     unsigned mFramesAllowed;                // How many buffers are we currently using
     unsigned mFramesInUse;                  // How many buffers are currently outstanding
 
     // Which format specific function we need to use to move camera imagery into our output buffers
     void(*mFillBufferFromVideo)(const BufferDesc& tgtBuff, uint8_t* tgt,
-                                void* imgData, unsigned imgStride);
+                                void* imgData, unsigned imgStride,
+                                const ColorConverter& converter,
+                                unsigned firstRow, unsigned endRow);
+
+    // True while the capture device is writing directly into mBuffers
+    bool mZeroCopy = false;
+    static bool sZeroCopyAllowed;
+    static bool sPersistentMapping;
+
+    // The YUV to RGB conversion tables for this camera.  Replaced rather than modified when the
+    // client changes the color settings so that a frame in flight keeps a consistent set.
+    std::shared_ptr<const ColorConverter> mColorConverter;
+
+    // A captured frame waiting to be converted into the output buffer claimed for it
+    struct ConvertJob {
+        imageBuffer*    v4lBuff;
+        void*           data;
+        unsigned        bufferId;
+        buffer_handle_t handle;
+        void*           pixels;     // The persistent mapping of handle, if it has one yet
+        std::shared_ptr<const ColorConverter> converter;
+    };
+
+    // A filled output buffer waiting to be sent to the client
+    struct DeliverJob {
+        unsigned        bufferId;
+        buffer_handle_t handle;
+    };
+
+    // Kept short since every queued frame is another buffer the client isn't seeing yet
+    StageQueue<ConvertJob>  mConvertQueue{2};
+    StageQueue<DeliverJob>  mDeliverQueue{2};
+    std::thread             mConvertThread;
+    std::thread             mDeliverThread;
+    std::atomic<unsigned>   mFramesSkipped{0};  // No buffer was free when the frame arrived
+
+    // Time spent getting each frame into its output buffer, for the current stream
+    std::atomic<uint64_t>   mConvertNanoseconds{0};
+    std::atomic<unsigned>   mFramesConverted{0};
 
     // Synchronization necessary to deconflict the capture thread from the main service thread
     // Note that the service interface remains single threaded (ie: not reentrant)
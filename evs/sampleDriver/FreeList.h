@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_FREELIST_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_FREELIST_H
+
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// A set of array indices with constant time insertion, membership test, and taking out of
+// any one member.  Not thread safe -- callers provide their own locking.
+class FreeList {
+public:
+    // Takes any member out of the list.  Returns false if the list is empty.
+    bool acquire(unsigned* idx) {
+        if (mItems.empty()) {
+            return false;
+        }
+        *idx = mItems.back();
+        mItems.pop_back();
+        mMember[*idx] = false;
+        return true;
+    }
+
+    // Adds idx to the list.  Does nothing if it is already there.
+    void release(unsigned idx) {
+        if (idx >= mMember.size()) {
+            mMember.resize(idx + 1, false);
+        }
+        if (!mMember[idx]) {
+            mMember[idx] = true;
+            mItems.push_back(idx);
+        }
+    }
+
+    bool contains(unsigned idx) const {
+        return idx < mMember.size() && mMember[idx];
+    }
+
+    void clear() {
+        mItems.clear();
+        mMember.clear();
+    }
+
+    unsigned size() const   { return mItems.size(); };
+    bool empty() const      { return mItems.empty(); };
+
+private:
+    std::vector<unsigned> mItems;       // The members, in no particular order
+    std::vector<bool>     mMember;      // Whether each index is in mItems
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_FREELIST_H
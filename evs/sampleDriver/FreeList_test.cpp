@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FreeList.h"
+
+using ::android::hardware::automotive::evs::V1_0::implementation::FreeList;
+
+
+TEST(FreeListTest, AcquireFromEmptyFails) {
+    FreeList list;
+    unsigned idx = 0;
+    EXPECT_FALSE(list.acquire(&idx));
+    EXPECT_TRUE(list.empty());
+}
+
+
+TEST(FreeListTest, ReleaseTwiceAddsOnce) {
+    FreeList list;
+    list.release(5);
+    list.release(5);
+    EXPECT_EQ(1U, list.size());
+    EXPECT_TRUE(list.contains(5));
+    EXPECT_FALSE(list.contains(4));
+
+    unsigned idx = 0;
+    ASSERT_TRUE(list.acquire(&idx));
+    EXPECT_EQ(5U, idx);
+    EXPECT_FALSE(list.contains(5));
+    EXPECT_FALSE(list.acquire(&idx));
+}
+
+
+TEST(FreeListTest, AcquireHandsOutEachMemberOnce) {
+    FreeList list;
+    const unsigned kCount = 100;
+    for (unsigned i = 0; i < kCount; i++) {
+        list.release(i);
+    }
+
+    std::vector<bool> seen(kCount, false);
+    unsigned idx = 0;
+    while (list.acquire(&idx)) {
+        ASSERT_LT(idx, kCount);
+        EXPECT_FALSE(seen[idx]) << "Index " << idx << " handed out twice";
+        seen[idx] = true;
+    }
+    for (unsigned i = 0; i < kCount; i++) {
+        EXPECT_TRUE(seen[i]) << "Index " << i << " never handed out";
+    }
+}
+
+
+TEST(FreeListTest, ClearEmptiesTheList) {
+    FreeList list;
+    list.release(1);
+    list.release(7);
+    list.clear();
+    EXPECT_TRUE(list.empty());
+    EXPECT_FALSE(list.contains(7));
+
+    list.release(7);
+    EXPECT_EQ(1U, list.size());
+}
+
+
+// Many threads taking slots and handing them back, under a lock as EvsV4lCamera does with its
+// capture and client threads.  No slot may be held by two threads at once, and none may go
+// missing.
+TEST(FreeListTest, ConcurrentAcquireRelease) {
+    const unsigned kSlots = 32;
+    const unsigned kThreads = 8;
+    const unsigned kRounds = 20000;
+
+    FreeList list;
+    std::mutex lock;
+    for (unsigned i = 0; i < kSlots; i++) {
+        list.release(i);
+    }
+
+    std::vector<std::atomic<bool>> held(kSlots);
+    for (auto&& h : held) {
+        h = false;
+    }
+    std::atomic<unsigned> doubleHeld(0);
+    std::atomic<unsigned> acquired(0);
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < kThreads; t++) {
+        threads.emplace_back([&]() {
+            std::vector<unsigned> mine;
+            for (unsigned round = 0; round < kRounds; round++) {
+                // Take a couple of slots at a time, so some threads find the list empty
+                for (unsigned i = 0; i < 2; i++) {
+                    unsigned idx = 0;
+                    bool got;
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        got = list.acquire(&idx);
+                    }
+                    if (got) {
+                        if (held[idx].exchange(true)) {
+                            doubleHeld++;
+                        }
+                        mine.push_back(idx);
+                        acquired++;
+                    }
+                }
+
+                // And give them back
+                for (unsigned idx : mine) {
+                    held[idx] = false;
+                    std::lock_guard<std::mutex> guard(lock);
+                    list.release(idx);
+                }
+                mine.clear();
+            }
+        });
+    }
+    for (auto&& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(0U, doubleHeld.load());
+    EXPECT_GT(acquired.load(), 0U);
+    EXPECT_EQ(kSlots, list.size());
+    for (unsigned i = 0; i < kSlots; i++) {
+        EXPECT_TRUE(list.contains(i));
+    }
+}
@@ -18,6 +18,7 @@
 #include <error.h>
 #include <errno.h>
 #include <memory.h>
+#include <algorithm>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
@@ -29,14 +30,26 @@
 #include "VideoCapture.h"
 
 
+// Enough to keep the device capturing while one frame is converted and another is delivered
+unsigned VideoCapture::sDefaultBufferCount = 4;
+
+// A device is reported as stalled once it goes this long without a frame
+unsigned VideoCapture::sStallThresholdMs = 1000;
+bool VideoCapture::sSharedCaptureThread = false;
+
+// The frame rate we negotiate for unless configured otherwise
+static const __u32 kDefaultFps = 30;
+
+
 // NOTE:  This developmental code does not properly clean up resources in case of failure
 //        during the resource setup phase.  Of particular note is the potential to leak
 //        the file descriptor.  This must be fixed before using this code for anything but
 //        experimentation.
-bool VideoCapture::open(const char* deviceName) {
-    // If we want a polling interface for getting frames, we would use O_NONBLOCK
-//    int mDeviceFd = open(deviceName, O_RDWR | O_NONBLOCK, 0);
-    mDeviceFd = ::open(deviceName, O_RDWR, 0);
+bool VideoCapture::open(const char* deviceName,
+                        const CaptureRequest& request,
+                        const std::vector<__u32>& acceptableFormats) {
+    // Frames are collected by polling, so a wedged device can never block the capture thread
+    mDeviceFd = ::open(deviceName, O_RDWR | O_NONBLOCK, 0);
     if (mDeviceFd < 0) {
         ALOGE("failed to open device %s (%d = %s)", deviceName, errno, strerror(errno));
         return false;
@@ -52,6 +65,7 @@ bool VideoCapture::open(const char* deviceName) {
     }
 
     // Report device properties
+    mDeviceName = deviceName;
     ALOGI("Open Device: %s (fd=%d)", deviceName, mDeviceFd);
     ALOGI("  Driver: %s", caps.driver);
     ALOGI("  Card: %s", caps.card);
@@ -64,6 +78,7 @@ bool VideoCapture::open(const char* deviceName) {
 
     // Enumerate the available capture formats (if any)
     ALOGI("Supported capture formats:");
+    std::vector<__u32> deviceFormats;
     v4l2_fmtdesc formatDescriptions;
     formatDescriptions.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     for (int i=0; true; i++) {
@@ -75,6 +90,7 @@ bool VideoCapture::open(const char* deviceName) {
                    formatDescriptions.pixelformat,
                    formatDescriptions.flags
             );
+            deviceFormats.push_back(formatDescriptions.pixelformat);
         } else {
             // No more formats available
             break;
@@ -89,23 +105,49 @@ bool VideoCapture::open(const char* deviceName) {
         return false;
     }
 
-    // Set our desired output format
-    v4l2_format format;
+    // Pick the format, size, and rate that best fit what our caller asked for
+    v4l2_format format = {};
     format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    format.fmt.pix.pixelformat = V4L2_PIX_FMT_UYVY; // Could/should we request V4L2_PIX_FMT_NV21?
-    format.fmt.pix.width = 720;                     // TODO:  Can we avoid hard coding dimensions?
-    format.fmt.pix.height = 240;                    // For now, this works with available hardware
-    format.fmt.pix.field = V4L2_FIELD_ALTERNATE;    // TODO:  Do we need to specify this?
-    ALOGI("Requesting format %c%c%c%c (0x%08X)",
+    if (ioctl(mDeviceFd, VIDIOC_G_FMT, &format) < 0) {
+        ALOGE("VIDIOC_G_FMT: %s", strerror(errno));
+        return false;
+    }
+    const __u32 targetFps = request.fps ? request.fps : kDefaultFps;
+    negotiateFormat(request, acceptableFormats, deviceFormats, targetFps, &format.fmt.pix);
+
+    // Set our desired output format.  Unless told otherwise we keep the field order the device
+    // reported, as interlaced sources (which often deliver alternating fields) rely on it.
+    if (request.field != V4L2_FIELD_ANY) {
+        format.fmt.pix.field = request.field;
+    }
+    ALOGI("Requesting format %c%c%c%c (0x%08X) %ux%u",
           ((char*)&format.fmt.pix.pixelformat)[0],
           ((char*)&format.fmt.pix.pixelformat)[1],
           ((char*)&format.fmt.pix.pixelformat)[2],
           ((char*)&format.fmt.pix.pixelformat)[3],
-          format.fmt.pix.pixelformat);
+          format.fmt.pix.pixelformat,
+          format.fmt.pix.width,
+          format.fmt.pix.height);
     if (ioctl(mDeviceFd, VIDIOC_S_FMT, &format) < 0) {
         ALOGE("VIDIOC_S_FMT: %s", strerror(errno));
     }
 
+    // Ask for our frame rate if the device lets us choose
+    v4l2_streamparm streamParm = {};
+    streamParm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(mDeviceFd, VIDIOC_G_PARM, &streamParm) == 0 &&
+        (streamParm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+        streamParm.parm.capture.timeperframe.numerator = 1;
+        streamParm.parm.capture.timeperframe.denominator = targetFps;
+        if (ioctl(mDeviceFd, VIDIOC_S_PARM, &streamParm) < 0) {
+            ALOGW("VIDIOC_S_PARM: %s", strerror(errno));
+        } else {
+            ALOGI("Frame interval set to %u/%u",
+                  streamParm.parm.capture.timeperframe.numerator,
+                  streamParm.parm.capture.timeperframe.denominator);
+        }
+    }
+
     // Report the current output format
     format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if (ioctl(mDeviceFd, VIDIOC_G_FMT, &format) == 0) {
@@ -115,11 +157,12 @@ bool VideoCapture::open(const char* deviceName) {
         mHeight = format.fmt.pix.height;
         mStride = format.fmt.pix.bytesperline;
 
-        ALOGI("Current output format:  fmt=0x%X, %dx%d, pitch=%d",
+        ALOGI("Current output format:  fmt=0x%X, %dx%d, pitch=%d, field=%d",
                format.fmt.pix.pixelformat,
                format.fmt.pix.width,
                format.fmt.pix.height,
-               format.fmt.pix.bytesperline
+               format.fmt.pix.bytesperline,
+               format.fmt.pix.field
         );
     } else {
         ALOGE("VIDIOC_G_FMT: %s", strerror(errno));
@@ -135,6 +178,137 @@ bool VideoCapture::open(const char* deviceName) {
 }
 
 
+// Returns true if the device can deliver the given format and size at least fps times a second.
+// Devices which can't enumerate their frame intervals are given the benefit of the doubt.
+bool VideoCapture::supportsRate(__u32 pixelFormat, __u32 width, __u32 height, __u32 fps) {
+    v4l2_frmivalenum interval = {};
+    interval.pixel_format = pixelFormat;
+    interval.width = width;
+    interval.height = height;
+    for (interval.index = 0; ioctl(mDeviceFd, VIDIOC_ENUM_FRAMEINTERVALS, &interval) == 0;
+         interval.index++) {
+        // Intervals are in seconds per frame
+        const v4l2_fract& shortest = (interval.type == V4L2_FRMIVAL_TYPE_DISCRETE) ?
+                                     interval.discrete : interval.stepwise.min;
+        if ((__u64)fps * shortest.numerator <= shortest.denominator) {
+            return true;
+        }
+        if (interval.type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+            // A single entry describes the whole range
+            return false;
+        }
+    }
+
+    return interval.index == 0;
+}
+
+
+// Finds the frame size closest to the requested one for the given format among those which can
+// deliver at least fps frames a second.  Returns false if no size can deliver that rate.
+bool VideoCapture::chooseFrameSize(__u32 pixelFormat, __u32 width, __u32 height, __u32 fps,
+                                   __u32* chosenWidth, __u32* chosenHeight) {
+    bool found = false;
+    __u32 bestDistance = ~0U;
+
+    v4l2_frmsizeenum size = {};
+    size.pixel_format = pixelFormat;
+    for (size.index = 0; ioctl(mDeviceFd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; size.index++) {
+        __u32 w, h;
+        if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+            w = size.discrete.width;
+            h = size.discrete.height;
+        } else {
+            // Snap the request onto the allowed range and step
+            const v4l2_frmsize_stepwise& range = size.stepwise;
+            w = std::min(std::max(width,  range.min_width),  range.max_width);
+            h = std::min(std::max(height, range.min_height), range.max_height);
+            if (range.step_width > 1) {
+                w -= (w - range.min_width) % range.step_width;
+            }
+            if (range.step_height > 1) {
+                h -= (h - range.min_height) % range.step_height;
+            }
+        }
+
+        const __u32 distance = (__u32)abs((int)w - (int)width) + (__u32)abs((int)h - (int)height);
+        if (distance < bestDistance && supportsRate(pixelFormat, w, h, fps)) {
+            bestDistance = distance;
+            *chosenWidth = w;
+            *chosenHeight = h;
+            found = true;
+        }
+
+        if (size.type != V4L2_FRMSIZE_TYPE_DISCRETE) {
+            // A single entry describes the whole range
+            break;
+        }
+    }
+
+    if (size.index == 0) {
+        // The device can't list its sizes, so ask for what we want and let S_FMT adjust it
+        *chosenWidth = width;
+        *chosenHeight = height;
+        found = supportsRate(pixelFormat, width, height, fps);
+    }
+
+    return found;
+}
+
+
+// Fills in the pixel format and size we should ask for.  pix starts out holding the device's
+// current settings, which are kept for anything the request doesn't specify.
+void VideoCapture::negotiateFormat(const CaptureRequest& request,
+                                   const std::vector<__u32>& acceptableFormats,
+                                   const std::vector<__u32>& deviceFormats,
+                                   __u32 fps,
+                                   v4l2_pix_format* pix) {
+    auto deviceSupports = [&deviceFormats](__u32 fmt) {
+        return std::find(deviceFormats.begin(), deviceFormats.end(), fmt) != deviceFormats.end();
+    };
+
+    // Candidates in order of preference.  Our caller lists them cheapest conversion first.
+    std::vector<__u32> candidates;
+    if (request.format) {
+        if (deviceSupports(request.format)) {
+            candidates.push_back(request.format);
+        } else {
+            ALOGW("Configured format 0x%08X isn't supported by this device", request.format);
+        }
+    }
+    if (candidates.empty()) {
+        for (auto&& fmt : acceptableFormats) {
+            if (deviceSupports(fmt)) {
+                candidates.push_back(fmt);
+            }
+        }
+    }
+    if (candidates.empty()) {
+        // Nothing we know how to use, so leave the device as it is and let our caller complain
+        ALOGW("No acceptable capture format found, keeping 0x%08X", pix->pixelformat);
+        return;
+    }
+
+    const __u32 width  = request.width  ? request.width  : pix->width;
+    const __u32 height = request.height ? request.height : pix->height;
+
+    // Take the cheapest format that can hit our frame rate.  If none can, take the cheapest.
+    pix->pixelformat = candidates[0];
+    pix->width = width;
+    pix->height = height;
+    for (auto&& fmt : candidates) {
+        __u32 w = width;
+        __u32 h = height;
+        if (chooseFrameSize(fmt, width, height, fps, &w, &h)) {
+            pix->pixelformat = fmt;
+            pix->width = w;
+            pix->height = h;
+            return;
+        }
+        ALOGI("Format 0x%08X can't deliver %ux%u at %u fps", fmt, width, height, fps);
+    }
+}
+
+
 void VideoCapture::close() {
     ALOGD("VideoCapture::close");
     // Stream should be stopped first!
@@ -148,73 +322,123 @@ void VideoCapture::close() {
 }
 
 
-bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback) {
-    // Set the state of our background thread
-    int prevRunMode = mRunMode.fetch_or(RUN);
-    if (prevRunMode & RUN) {
-        // The background thread is already running, so we can't start a new stream
-        ALOGE("Already in RUN state, so we can't start a new streaming thread");
-        return false;
-    }
-
+// Allocates our ring of capture buffers in the driver, maps them, and queues them for capture
+bool VideoCapture::prepareMmapBuffers() {
     // Tell the L4V2 driver to prepare our streaming buffers
     v4l2_requestbuffers bufrequest;
     bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     bufrequest.memory = V4L2_MEMORY_MMAP;
-    bufrequest.count = 1;
+    bufrequest.count = std::min(std::max(mBufferCount, 1U), (unsigned)VIDEO_MAX_FRAME);
     if (ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
         ALOGE("VIDIOC_REQBUFS: %s", strerror(errno));
         return false;
     }
-
-    // Get the information on the buffer that was created for us
-    memset(&mBufferInfo, 0, sizeof(mBufferInfo));
-    mBufferInfo.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    mBufferInfo.memory   = V4L2_MEMORY_MMAP;
-    mBufferInfo.index    = 0;
-    if (ioctl(mDeviceFd, VIDIOC_QUERYBUF, &mBufferInfo) < 0) {
-        ALOGE("VIDIOC_QUERYBUF: %s", strerror(errno));
+    if (bufrequest.count < 1) {
+        ALOGE("VIDIOC_REQBUFS: no buffers were provided");
         return false;
     }
+    ALOGI("Capturing into %u buffers", bufrequest.count);
+
+    for (unsigned i = 0; i < bufrequest.count; i++) {
+        // Get the information on the buffer that was created for us
+        MmapBuffer buffer = {};
+        buffer.info.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.info.memory   = V4L2_MEMORY_MMAP;
+        buffer.info.index    = i;
+        if (ioctl(mDeviceFd, VIDIOC_QUERYBUF, &buffer.info) < 0) {
+            ALOGE("VIDIOC_QUERYBUF: %s", strerror(errno));
+            releaseMmapBuffers();
+            return false;
+        }
+
+        ALOGI("Buffer %u description:", i);
+        ALOGI("  offset: %d", buffer.info.m.offset);
+        ALOGI("  length: %d", buffer.info.length);
+
+        // Get a pointer to the buffer contents by mapping into our address space
+        buffer.data = mmap(
+                NULL,
+                buffer.info.length,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED,
+                mDeviceFd,
+                buffer.info.m.offset
+        );
+        if (buffer.data == MAP_FAILED) {
+            ALOGE("mmap: %s", strerror(errno));
+            releaseMmapBuffers();
+            return false;
+        }
+        memset(buffer.data, 0, buffer.info.length);
+        ALOGI("Buffer mapped at %p", buffer.data);
+
+        mMmapBuffers.push_back(buffer);
+    }
+
+    // Queue all the capture buffers
+    for (auto&& buffer : mMmapBuffers) {
+        if (ioctl(mDeviceFd, VIDIOC_QBUF, &buffer.info) < 0) {
+            ALOGE("VIDIOC_QBUF: %s", strerror(errno));
+            releaseMmapBuffers();
+            return false;
+        }
+    }
 
-    ALOGI("Buffer description:");
-    ALOGI("  offset: %d", mBufferInfo.m.offset);
-    ALOGI("  length: %d", mBufferInfo.length);
-
-    // Get a pointer to the buffer contents by mapping into our address space
-    mPixelBuffer = mmap(
-            NULL,
-            mBufferInfo.length,
-            PROT_READ | PROT_WRITE,
-            MAP_SHARED,
-            mDeviceFd,
-            mBufferInfo.m.offset
-    );
-    if( mPixelBuffer == MAP_FAILED) {
-        ALOGE("mmap: %s", strerror(errno));
+    return true;
+}
+
+
+void VideoCapture::releaseMmapBuffers() {
+    for (auto&& buffer : mMmapBuffers) {
+        munmap(buffer.data, buffer.info.length);
+    }
+    mMmapBuffers.clear();
+    mLatestData = nullptr;
+}
+
+
+bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback) {
+    // Set the state of our background thread
+    int prevRunMode = mRunMode.fetch_or(RUN);
+    if (prevRunMode & RUN) {
+        // The background thread is already running, so we can't start a new stream
+        ALOGE("Already in RUN state, so we can't start a new streaming thread");
         return false;
     }
-    memset(mPixelBuffer, 0, mBufferInfo.length);
-    ALOGI("Buffer mapped at %p", mPixelBuffer);
 
-    // Queue the first capture buffer
-    if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfo) < 0) {
-        ALOGE("VIDIOC_QBUF: %s", strerror(errno));
+    // In DMABUF mode the caller owns the buffers and queues them itself
+    if (!isUsingDmabuf() && !prepareMmapBuffers()) {
+        mRunMode = STOPPED;
         return false;
     }
 
     // Start the video stream
-    int type = mBufferInfo.type;
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if (ioctl(mDeviceFd, VIDIOC_STREAMON, &type) < 0) {
         ALOGE("VIDIOC_STREAMON: %s", strerror(errno));
+        mRunMode = STOPPED;
         return false;
     }
 
     // Remember who to tell about new frames as they arrive
     mCallback = callback;
+    mLastFrameTime = std::chrono::steady_clock::now();
+    mStalled = false;
 
-    // Fire up a thread to receive and dispatch the video frames
-    mCaptureThread = std::thread([this](){ collectFrames(); });
+    // Have a capture thread watch for video frames and dispatch them
+    if (sSharedCaptureThread) {
+        mLoop = &CaptureLoop::getShared();
+    } else {
+        mOwnLoop.reset(new CaptureLoop());
+        mLoop = mOwnLoop.get();
+    }
+    if (!mLoop->addCapture(this)) {
+        mLoop = nullptr;
+        mOwnLoop.reset();
+        ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type);
+        mRunMode = STOPPED;
+        return false;
+    }
 
     ALOGD("Stream started.");
     return true;
@@ -231,46 +455,101 @@ void VideoCapture::stopStream() {
         ALOGE("stopStream called while stream is already stopping.  Reentrancy is not supported!");
         return;
     } else {
-        // Block until the background thread is stopped
-        if (mCaptureThread.joinable()) {
-            mCaptureThread.join();
+        // Block until the capture thread is done with us
+        if (mLoop) {
+            mLoop->removeCapture(this);
+            mLoop = nullptr;
         }
+        mOwnLoop.reset();
 
         // Stop the underlying video stream (automatically empties the buffer queue)
-        int type = mBufferInfo.type;
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         if (ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type) < 0) {
             ALOGE("VIDIOC_STREAMOFF: %s", strerror(errno));
         }
 
         ALOGD("Capture thread stopped.");
+        mRunMode = STOPPED;
     }
 
-    // Unmap the buffers we allocated
-    munmap(mPixelBuffer, mBufferInfo.length);
+    // Unmap the buffers we allocated (DMABUF buffers belong to our caller)
+    releaseMmapBuffers();
 
     // Tell the L4V2 driver to release our streaming buffers
     v4l2_requestbuffers bufrequest;
     bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    bufrequest.memory = V4L2_MEMORY_MMAP;
+    bufrequest.memory = mMemoryType;
     bufrequest.count = 0;
     ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest);
 
+    // Go back to our own buffers unless the next stream asks otherwise
+    mMemoryType = V4L2_MEMORY_MMAP;
+    mDmabufCount = 0;
+
     // Drop our reference to the frame delivery callback interface
     mCallback = nullptr;
 }
 
 
+bool VideoCapture::useDmabuf(unsigned bufferCount) {
+    if (mRunMode != STOPPED) {
+        ALOGE("Can't change the buffer type of a running stream");
+        return false;
+    }
+
+    // Ask for slots to import buffers into.  The driver may give us fewer than we asked for.
+    v4l2_requestbuffers bufrequest = {};
+    bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    bufrequest.memory = V4L2_MEMORY_DMABUF;
+    bufrequest.count = bufferCount;
+    if (ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
+        ALOGI("DMABUF import not available (%s)", strerror(errno));
+        return false;
+    }
+    if (bufrequest.count < 1) {
+        ALOGI("DMABUF import not available (no buffer slots)");
+        return false;
+    }
+
+    ALOGI("Capturing into %u imported DMABUF slots", bufrequest.count);
+    mMemoryType = V4L2_MEMORY_DMABUF;
+    mDmabufCount = bufrequest.count;
+    return true;
+}
+
+
+bool VideoCapture::queueDmabuf(unsigned index, int fd) {
+    v4l2_buffer buf = {};
+    buf.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory   = V4L2_MEMORY_DMABUF;
+    buf.index    = index;
+    buf.m.fd     = fd;
+    buf.length   = 0;   // Zero tells the driver to use the size of the dmabuf itself
+    if (ioctl(mDeviceFd, VIDIOC_QBUF, &buf) < 0) {
+        ALOGE("VIDIOC_QBUF (dmabuf %u): %s", index, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+
 void VideoCapture::markFrameReady() {
     mFrameReady = true;
 };
 
 
-bool VideoCapture::returnFrame() {
+bool VideoCapture::returnFrame(imageBuffer* frame) {
     // We're giving the frame back to the system, so clear the "ready" flag
     mFrameReady = false;
 
+    if (frame->index >= mMmapBuffers.size()) {
+        ALOGE("Ignoring return of unknown capture buffer %u", frame->index);
+        return false;
+    }
+
     // Requeue the buffer to capture the next available frame
-    if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfo) < 0) {
+    if (ioctl(mDeviceFd, VIDIOC_QBUF, &mMmapBuffers[frame->index].info) < 0) {
         ALOGE("VIDIOC_QBUF: %s", strerror(errno));
         return false;
     }
@@ -279,25 +558,74 @@ bool VideoCapture::returnFrame() {
 }
 
 
-// This runs on a background thread to receive and dispatch video frames
-void VideoCapture::collectFrames() {
-    // Run until our atomic signal is cleared
-    while (mRunMode == RUN) {
-        // Wait for a buffer to be ready
-        if (ioctl(mDeviceFd, VIDIOC_DQBUF, &mBufferInfo) < 0) {
-            ALOGE("VIDIOC_DQBUF: %s", strerror(errno));
-            break;
-        }
+// Called on the capture thread when the device has signaled it's ready.  Returns false if the
+// capture thread should stop listening to the device: it reported an error, or our stream is
+// stopping (the device stays readable until then, and we won't be taking any more frames).
+bool VideoCapture::dequeueFrame() {
+    if (mRunMode != RUN) {
+        return false;
+    }
 
-        markFrameReady();
+    v4l2_buffer buf = {};
+    buf.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory   = mMemoryType;
+    if (ioctl(mDeviceFd, VIDIOC_DQBUF, &buf) < 0) {
+        if (errno == EAGAIN) {
+            // Nothing ready after all
+            return true;
+        }
+        ALOGE("VIDIOC_DQBUF (%s): %s", mDeviceName.c_str(), strerror(errno));
+        return false;
+    }
 
-        // If a callback was requested per frame, do that now
-        if (mCallback) {
-            mCallback(this, &mBufferInfo, mPixelBuffer);
+    // Note the arrival of the frame, and the end of any stall
+    const auto now = std::chrono::steady_clock::now();
+    if (mStalled) {
+        ALOGI("%s resumed after %lld ms without a frame", mDeviceName.c_str(),
+              (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                      now - mLastFrameTime).count());
+        mStalled = false;
+    }
+    mLastFrameTime = now;
+
+    // Work out which of our buffers the device filled
+    imageBuffer* frame = &buf;
+    void* data = nullptr;
+    if (!isUsingDmabuf()) {
+        if (buf.index >= mMmapBuffers.size()) {
+            ALOGE("VIDIOC_DQBUF returned unknown buffer %u", buf.index);
+            return true;
         }
+        MmapBuffer& buffer = mMmapBuffers[buf.index];
+        buffer.info = buf;
+        frame = &buffer.info;
+        data = buffer.data;
+        mLatestData = data;
     }
 
-    // Mark ourselves stopped
-    ALOGD("VideoCapture thread ending");
-    mRunMode = STOPPED;
+    markFrameReady();
+
+    // If a callback was requested per frame, do that now
+    if (mCallback) {
+        mCallback(this, frame, data);
+    }
+
+    return true;
+}
+
+
+// Called periodically on the capture thread to report a device which has stopped delivering
+void VideoCapture::checkForStall(std::chrono::steady_clock::time_point now) {
+    if (mStalled || sStallThresholdMs == 0 || mRunMode != RUN) {
+        return;
+    }
+
+    const auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - mLastFrameTime).count();
+    if (waited >= sStallThresholdMs) {
+        mStalled = true;
+        mStallCount++;
+        ALOGW("%s has not delivered a frame in %lld ms (stall %u)",
+              mDeviceName.c_str(), (long long)waited, mStallCount.load());
+    }
 }
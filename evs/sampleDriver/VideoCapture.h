@@ -17,45 +17,116 @@
 #define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_VIDEOCAPTURE_H
 
 #include <atomic>
-#include <thread>
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 #include <linux/videodev2.h>
 
+#include "CaptureLoop.h"
+
 
 typedef v4l2_buffer imageBuffer;
 
 
+// What we'd like the device to deliver.  Zero means no preference.
+struct CaptureRequest {
+    __u32   format = 0;     // V4L2 fourcc which overrides the negotiated format
+    __u32   width  = 0;
+    __u32   height = 0;
+    __u32   fps    = 0;
+    __u32   field  = V4L2_FIELD_ANY;    // Field order, or ANY to keep the device's current one
+};
+
+
 class VideoCapture {
 public:
-    bool open(const char* deviceName);
+    // Opens the device and chooses the capture format.  acceptableFormats lists the V4L2
+    // formats the caller can use in order of preference (ie: cheapest to convert first).  The
+    // first of them the device can deliver at the requested size and rate is chosen.
+    bool open(const char* deviceName,
+              const CaptureRequest& request = CaptureRequest(),
+              const std::vector<__u32>& acceptableFormats = std::vector<__u32>());
     void close();
 
     bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr);
     void stopStream();
 
+    // How many mmapped buffers the device captures into.  With more than one, the device keeps
+    // capturing into the others while a delivered frame is still being processed.  Takes effect
+    // at the next startStream().  The device may adjust the number it actually provides.
+    void setBufferCount(unsigned count) { mBufferCount = count; };
+    static void setDefaultBufferCount(unsigned count) { sDefaultBufferCount = count; };
+
+    // A warning is logged when a streaming device goes this long without a frame (0 disables)
+    static void setStallThreshold(unsigned milliseconds) { sStallThresholdMs = milliseconds; };
+    unsigned getStallCount()    { return mStallCount; };
+
+    // When set before any stream starts, all devices share one capture thread rather than
+    // each starting its own
+    static void setSharedCaptureThread(bool shared) { sSharedCaptureThread = shared; };
+
+    // Switches the next stream to capture directly into buffers provided by the caller as
+    // DMABUF file descriptors instead of into our own mmapped buffers.  Must be called before
+    // startStream().  Returns false, leaving the stream in mmap mode, if the device can't do it.
+    // In this mode frames are delivered to the callback with a null data pointer and are never
+    // requeued automatically -- each buffer must be handed back with queueDmabuf().
+    bool useDmabuf(unsigned bufferCount);
+    bool queueDmabuf(unsigned index, int fd);
+    bool isUsingDmabuf()        { return mMemoryType == V4L2_MEMORY_DMABUF; };
+    unsigned getDmabufCount()   { return mDmabufCount; };
+
     // Valid only after open()
     __u32   getWidth()          { return mWidth; };
     __u32   getHeight()         { return mHeight; };
     __u32   getStride()         { return mStride; };
     __u32   getV4LFormat()      { return mFormat; };
 
-    // NULL until stream is started
-    void* getLatestData()       { return mPixelBuffer; };
+    // NULL until the first frame arrives
+    void* getLatestData()       { return mLatestData; };
 
+    // Each frame passed to the callback must be handed back here once its contents are no
+    // longer needed so the device can capture into it again
     bool isFrameReady()         { return mFrameReady; };
-    void markFrameConsumed()    { returnFrame(); };
+    void markFrameConsumed(imageBuffer* frame)  { returnFrame(frame); };
 
     bool isOpen()               { return mDeviceFd >= 0; };
 
 private:
-    void collectFrames();
+    friend class CaptureLoop;
+    bool dequeueFrame();
+    void checkForStall(std::chrono::steady_clock::time_point now);
+
     void markFrameReady();
-    bool returnFrame();
+    bool returnFrame(imageBuffer* frame);
+    bool prepareMmapBuffers();
+    bool supportsRate(__u32 pixelFormat, __u32 width, __u32 height, __u32 fps);
+    bool chooseFrameSize(__u32 pixelFormat, __u32 width, __u32 height, __u32 fps,
+                         __u32* chosenWidth, __u32* chosenHeight);
+    void negotiateFormat(const CaptureRequest& request,
+                         const std::vector<__u32>& acceptableFormats,
+                         const std::vector<__u32>& deviceFormats,
+                         __u32 fps,
+                         v4l2_pix_format* pix);
+    void releaseMmapBuffers();
 
     int mDeviceFd = -1;
+    std::string mDeviceName;
 
-    v4l2_buffer mBufferInfo = {};
-    void* mPixelBuffer = nullptr;
+    // The ring of buffers the device captures into in mmap mode, indexed by V4L2 buffer index
+    struct MmapBuffer {
+        v4l2_buffer info;
+        void*       data;
+    };
+    std::vector<MmapBuffer> mMmapBuffers;
+    unsigned mBufferCount = sDefaultBufferCount;
+    void* mLatestData = nullptr;
+
+    static unsigned sDefaultBufferCount;
+
+    __u32    mMemoryType = V4L2_MEMORY_MMAP;
+    unsigned mDmabufCount = 0;      // Buffer slots the driver gave us in DMABUF mode
 
     __u32   mFormat = 0;
     __u32   mWidth  = 0;
@@ -64,7 +135,17 @@ private:
 
     std::function<void(VideoCapture*, imageBuffer*, void*)> mCallback;
 
-    std::thread mCaptureThread;             // The thread we'll use to dispatch frames
+    CaptureLoop* mLoop = nullptr;           // The thread dispatching our frames
+    std::unique_ptr<CaptureLoop> mOwnLoop;  // Our private capture thread, if not shared
+
+    // Stall detection, only touched on the capture thread
+    std::chrono::steady_clock::time_point mLastFrameTime;
+    bool mStalled = false;
+    std::atomic<unsigned> mStallCount{0};
+
+    static unsigned sStallThresholdMs;
+    static bool     sSharedCaptureThread;
+
     std::atomic<int> mRunMode;              // Used to signal the frame loop (see RunModes below)
     std::atomic<bool> mFrameReady;          // Set when a frame has been delivered
 
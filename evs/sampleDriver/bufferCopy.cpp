@@ -15,6 +15,15 @@
  */
 
 #include "bufferCopy.h"
+#include "bufferCopyKernels.h"
+
+#include <string.h>
+#include <cutils/log.h>
+
+#if defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
 
 
 namespace android {
@@ -36,36 +45,120 @@ int align(int value) {
 }
 
 
-// Limit the given value to the provided range.  :)
-static inline float clamp(float v, float min, float max) {
-    if (v < min) return min;
-    if (v > max) return max;
-    return v;
+void rgbaFromYuyvRowScalar(const uint8_t* src, uint32_t* dst, unsigned width,
+                           const ColorConverter& converter) {
+    const uint32_t* srcWords = (const uint32_t*)src;
+    for (unsigned c=0; c<width/2; c++) {
+        // Note:  we're walking two pixels at a time here (even/odd)
+        uint32_t srcPixel = *srcWords++;
+
+        uint8_t Y1 = (srcPixel)       & 0xFF;
+        uint8_t U  = (srcPixel >> 8)  & 0xFF;
+        uint8_t Y2 = (srcPixel >> 16) & 0xFF;
+        uint8_t V  = (srcPixel >> 24) & 0xFF;
+
+        // On the RGB output, we're writing one pixel at a time
+        *(dst+0) = converter.yuvToRgbx(Y1, U, V);
+        *(dst+1) = converter.yuvToRgbx(Y2, U, V);
+        dst += 2;
+    }
+}
+
+
+void nv21FromYuyvRowsScalar(const uint8_t* srcTop, const uint8_t* srcBot,
+                            uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    struct YUYVpixel {
+        uint8_t Y1;
+        uint8_t U;
+        uint8_t Y2;
+        uint8_t V;
+    };
+    const YUYVpixel* topRow = (const YUYVpixel*)srcTop;
+    const YUYVpixel* botRow = (const YUYVpixel*)srcBot;
+
+    for (unsigned cellCol = 0; cellCol < width/2; cellCol++) {
+        // Collect the values from the YUYV interleaved data
+        const YUYVpixel* pTopMacroPixel = &topRow[cellCol];
+        const YUYVpixel* pBotMacroPixel = &botRow[cellCol];
+
+        // Down sample the U/V values by linear average between rows
+        const uint8_t uValue = (pTopMacroPixel->U + pBotMacroPixel->U) >> 1;
+        const uint8_t vValue = (pTopMacroPixel->V + pBotMacroPixel->V) >> 1;
+
+        // Store the values into the NV21 layout
+        yTop[cellCol*2]   = pTopMacroPixel->Y1;
+        yTop[cellCol*2+1] = pTopMacroPixel->Y2;
+        yBot[cellCol*2]   = pBotMacroPixel->Y1;
+        yBot[cellCol*2+1] = pBotMacroPixel->Y2;
+        uv[cellCol*2]     = uValue;
+        uv[cellCol*2+1]   = vValue;
+    }
+}
+
+
+void yuyvFromUyvyRowScalar(const uint8_t* src, uint8_t* dst, unsigned width) {
+    const uint32_t* srcWords = (const uint32_t*)src;
+    uint32_t* dstWords = (uint32_t*)dst;
+    for (unsigned c=0; c<width/2; c++) {
+        // Note:  we're walking two pixels at a time here (even/odd)
+        uint32_t srcPixel = *srcWords++;
+
+        uint8_t Y1 = (srcPixel)       & 0xFF;
+        uint8_t U  = (srcPixel >> 8)  & 0xFF;
+        uint8_t Y2 = (srcPixel >> 16) & 0xFF;
+        uint8_t V  = (srcPixel >> 24) & 0xFF;
+
+        // Now we write back the pair of pixels with the components swizzled
+        *dstWords++ = (U)        |
+                      (Y1 << 8)  |
+                      (V  << 16) |
+                      (Y2 << 24);
+    }
+}
+
+
+static const BufferCopyKernels kScalarKernels = {
+    .name               = "scalar",
+    .rgbaFromYuyvRow    = rgbaFromYuyvRowScalar,
+    .nv21FromYuyvRows   = nv21FromYuyvRowsScalar,
+    .yuyvFromUyvyRow    = yuyvFromUyvyRowScalar,
+};
+
+
+static const BufferCopyKernels* selectBufferCopyKernels() {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &kAvx2Kernels;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return &kSse41Kernels;
+    }
+#elif defined(__aarch64__)
+    // Advanced SIMD is a mandatory part of ARMv8-A
+    return &kNeonKernels;
+#elif defined(__arm__)
+    if (getauxval(AT_HWCAP) & HWCAP_NEON) {
+        return &kNeonKernels;
+    }
+#endif
+    return &kScalarKernels;
 }
 
 
-static uint32_t yuvToRgbx(const unsigned char Y, const unsigned char Uin, const unsigned char Vin) {
-    // Don't use this if you want to see the best performance.  :)
-    // Better to do this in a pixel shader if we really have to, but on actual
-    // embedded hardware we expect to be able to texture directly from the YUV data
-    float U = Uin - 128.0f;
-    float V = Vin - 128.0f;
-
-    float Rf = Y + 1.140f*V;
-    float Gf = Y - 0.395f*U - 0.581f*V;
-    float Bf = Y + 2.032f*U;
-    unsigned char R = (unsigned char)clamp(Rf, 0.0f, 255.0f);
-    unsigned char G = (unsigned char)clamp(Gf, 0.0f, 255.0f);
-    unsigned char B = (unsigned char)clamp(Bf, 0.0f, 255.0f);
-
-    return ((R & 0xFF))       |
-           ((G & 0xFF) << 8)  |
-           ((B & 0xFF) << 16) |
-           0xFF000000;  // Fill the alpha channel with ones
+const BufferCopyKernels& getBufferCopyKernels() {
+    static const BufferCopyKernels* sKernels = [](){
+        const BufferCopyKernels* kernels = selectBufferCopyKernels();
+        ALOGI("Using %s buffer copy kernels", kernels->name);
+        return kernels;
+    }();
+
+    return *sKernels;
 }
 
 
-void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned) {
+void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned,
+                      const ColorConverter&, unsigned firstRow, unsigned endRow) {
     // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleave U/V array.
     // It assumes an even width and height for the overall image, and a horizontal stride that is
     // an even multiple of 16 bytes for both the Y and UV arrays.
@@ -74,15 +167,17 @@ void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     const unsigned strideLum = align<16>(tgtBuff.width);
     const unsigned sizeY = strideLum * tgtBuff.height;
     const unsigned strideColor = strideLum;   // 1/2 the samples, but two interleaved channels
-    const unsigned sizeColor = strideColor * tgtBuff.height/2;
-    const unsigned totalBytes = sizeY + sizeColor;
 
-    // Simply copy the data byte for byte
-    memcpy(tgt, imgData, totalBytes);
+    // Simply copy the data byte for byte, first the Y rows, then the U/V rows that go with them
+    const uint8_t* src = (const uint8_t*)imgData;
+    memcpy(tgt + firstRow*strideLum, src + firstRow*strideLum, (endRow - firstRow) * strideLum);
+    memcpy(tgt + sizeY + firstRow/2*strideColor, src + sizeY + firstRow/2*strideColor,
+           (endRow - firstRow)/2 * strideColor);
 }
 
 
-void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      const ColorConverter&, unsigned firstRow, unsigned endRow) {
     // The YUYV format provides an interleaved array of pixel values with U and V subsampled in
     // the horizontal direction only.  Also known as interleaved 422 format.  A 4 byte
     // "macro pixel" provides the Y value for two adjacent pixels and the U and V values shared
@@ -91,13 +186,8 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     // to construct the NV21 format.
     // NV21 requires even width and height, so we assume that is the case for the incomming image
     // as well.
+    const BufferCopyKernels& kernels = getBufferCopyKernels();
     uint32_t *srcDataYUYV = (uint32_t*)imgData;
-    struct YUYVpixel {
-        uint8_t Y1;
-        uint8_t U;
-        uint8_t Y2;
-        uint8_t V;
-    };
 
     // Target image layout properties
     const unsigned strideLum = align<16>(tgtBuff.width);
@@ -107,34 +197,19 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     // Source image layout properties
     const unsigned srcRowPixels = imgStride/4;  // imgStride is in units of bytes
     const unsigned srcRowDoubleStep = srcRowPixels * 2;
-    uint32_t* topSrcRow =  srcDataYUYV;
-    uint32_t* botSrcRow =  srcDataYUYV + srcRowPixels;
+    uint32_t* topSrcRow =  srcDataYUYV + firstRow * srcRowPixels;
+    uint32_t* botSrcRow =  topSrcRow + srcRowPixels;
 
-    // We're going to work on one 2x2 cell in the output image at at time
-    for (unsigned cellRow = 0; cellRow < tgtBuff.height/2; cellRow++) {
+    // We're going to work on one row of 2x2 cells in the output image at at time
+    for (unsigned cellRow = firstRow/2; cellRow < endRow/2; cellRow++) {
 
         // Set up the output pointers
         uint8_t* yTopRow = tgt + (cellRow*2) * strideLum;
         uint8_t* yBotRow = yTopRow + strideLum;
         uint8_t* uvRow   = (tgt + sizeY) + cellRow * strideColor;
 
-        for (unsigned cellCol = 0; cellCol < tgtBuff.width/2; cellCol++) {
-            // Collect the values from the YUYV interleaved data
-            const YUYVpixel* pTopMacroPixel = (YUYVpixel*)&topSrcRow[cellCol];
-            const YUYVpixel* pBotMacroPixel = (YUYVpixel*)&botSrcRow[cellCol];
-
-            // Down sample the U/V values by linear average between rows
-            const uint8_t uValue = (pTopMacroPixel->U + pBotMacroPixel->U) >> 1;
-            const uint8_t vValue = (pTopMacroPixel->V + pBotMacroPixel->V) >> 1;
-
-            // Store the values into the NV21 layout
-            yTopRow[cellCol*2]   = pTopMacroPixel->Y1;
-            yTopRow[cellCol*2+1] = pTopMacroPixel->Y2;
-            yBotRow[cellCol*2]   = pBotMacroPixel->Y1;
-            yBotRow[cellCol*2+1] = pBotMacroPixel->Y2;
-            uvRow[cellCol*2]     = uValue;
-            uvRow[cellCol*2+1]   = vValue;
-        }
+        kernels.nv21FromYuyvRows((uint8_t*)topSrcRow, (uint8_t*)botSrcRow,
+                                 yTopRow, yBotRow, uvRow, tgtBuff.width);
 
         // Skipping two rows to get to the next set of two source rows
         topSrcRow += srcRowDoubleStep;
@@ -143,86 +218,63 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
 }
 
 
-void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      const ColorConverter& converter, unsigned firstRow, unsigned endRow) {
+    const BufferCopyKernels& kernels = getBufferCopyKernels();
     unsigned width = tgtBuff.width;
-    unsigned height = tgtBuff.height;
-    uint32_t* src = (uint32_t*)imgData;
-    uint32_t* dst = (uint32_t*)tgt;
     unsigned srcStridePixels = imgStride / 2;
     unsigned dstStridePixels = tgtBuff.stride;
 
-    const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
-    const int dstRowPadding32 = dstStridePixels   - width;    // 4 bytes per pixel, 4 bytes per word
-
-    for (unsigned r=0; r<height; r++) {
-        for (unsigned c=0; c<width/2; c++) {
-            // Note:  we're walking two pixels at a time here (even/odd)
-            uint32_t srcPixel = *src++;
+    const int srcRowStep32 = srcStridePixels/2;   // 2 bytes per pixel, 4 bytes per word
+    const int dstRowStep32 = dstStridePixels;     // 4 bytes per pixel, 4 bytes per word
 
-            uint8_t Y1 = (srcPixel)       & 0xFF;
-            uint8_t U  = (srcPixel >> 8)  & 0xFF;
-            uint8_t Y2 = (srcPixel >> 16) & 0xFF;
-            uint8_t V  = (srcPixel >> 24) & 0xFF;
+    uint32_t* src = (uint32_t*)imgData + firstRow * srcRowStep32;
+    uint32_t* dst = (uint32_t*)tgt + firstRow * dstRowStep32;
 
-            // On the RGB output, we're writing one pixel at a time
-            *(dst+0) = yuvToRgbx(Y1, U, V);
-            *(dst+1) = yuvToRgbx(Y2, U, V);
-            dst += 2;
-        }
+    for (unsigned r=firstRow; r<endRow; r++) {
+        kernels.rgbaFromYuyvRow((uint8_t*)src, dst, width, converter);
 
-        // Skip over any extra data or end of row alignment padding
-        src += srcRowPadding32;
-        dst += dstRowPadding32;
+        // Step over the row, including any extra data or end of row alignment padding
+        src += srcRowStep32;
+        dst += dstRowStep32;
     }
 }
 
 
-void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      const ColorConverter&, unsigned firstRow, unsigned endRow) {
     unsigned width = tgtBuff.width;
-    unsigned height = tgtBuff.height;
     uint8_t* src = (uint8_t*)imgData;
     uint8_t* dst = (uint8_t*)tgt;
     unsigned srcStrideBytes = imgStride;
     unsigned dstStrideBytes = tgtBuff.stride * 2;
 
-    for (unsigned r=0; r<height; r++) {
+    for (unsigned r=firstRow; r<endRow; r++) {
         // Copy a pixel row at a time (2 bytes per pixel, averaged over a YUYV macro pixel)
         memcpy(dst+r*dstStrideBytes, src+r*srcStrideBytes, width*2);
     }
 }
 
 
-void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      const ColorConverter&, unsigned firstRow, unsigned endRow) {
+    const BufferCopyKernels& kernels = getBufferCopyKernels();
     unsigned width = tgtBuff.width;
-    unsigned height = tgtBuff.height;
-    uint32_t* src = (uint32_t*)imgData;
-    uint32_t* dst = (uint32_t*)tgt;
     unsigned srcStridePixels = imgStride / 2;
     unsigned dstStridePixels = tgtBuff.stride;
 
-    const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
-    const int dstRowPadding32 = dstStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
-
-    for (unsigned r=0; r<height; r++) {
-        for (unsigned c=0; c<width/2; c++) {
-            // Note:  we're walking two pixels at a time here (even/odd)
-            uint32_t srcPixel = *src++;
-
-            uint8_t Y1 = (srcPixel)       & 0xFF;
-            uint8_t U  = (srcPixel >> 8)  & 0xFF;
-            uint8_t Y2 = (srcPixel >> 16) & 0xFF;
-            uint8_t V  = (srcPixel >> 24) & 0xFF;
-
-            // Now we write back the pair of pixels with the components swizzled
-            *dst++ = (U)        |
-                     (Y1 << 8)  |
-                     (V  << 16) |
-                     (Y2 << 24);
-        }
-
-        // Skip over any extra data or end of row alignment padding
-        src += srcRowPadding32;
-        dst += dstRowPadding32;
+    const int srcRowStep32 = srcStridePixels/2;   // 2 bytes per pixel, 4 bytes per word
+    const int dstRowStep32 = dstStridePixels/2;   // 2 bytes per pixel, 4 bytes per word
+
+    uint32_t* src = (uint32_t*)imgData + firstRow * srcRowStep32;
+    uint32_t* dst = (uint32_t*)tgt + firstRow * dstRowStep32;
+
+    for (unsigned r=firstRow; r<endRow; r++) {
+        kernels.yuyvFromUyvyRow((uint8_t*)src, (uint8_t*)dst, width);
+
+        // Step over the row, including any extra data or end of row alignment padding
+        src += srcRowStep32;
+        dst += dstRowStep32;
     }
 }
 
@@ -19,6 +19,8 @@
 
 #include <android/hardware/automotive/evs/1.0/types.h>
 
+#include "ColorConvert.h"
+
 
 namespace android {
 namespace hardware {
@@ -28,20 +30,38 @@ namespace V1_0 {
 namespace implementation {
 
 
+using ::android::automotive::evs::support::ColorConverter;
+
+
+// Each of these transfers a camera image into a gralloc buffer of the format named first,
+// converting from the format named second.  The converter is only consulted by functions
+// which have to turn YUV into RGB.
+// Only image rows [firstRow, endRow) are transferred so that a frame can be split across
+// several threads.  For NV21 output both values must be even.
 void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      const ColorConverter& converter,
+                      unsigned firstRow, unsigned endRow);
 
 void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      const ColorConverter& converter,
+                      unsigned firstRow, unsigned endRow);
 
 void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      const ColorConverter& converter,
+                      unsigned firstRow, unsigned endRow);
 
 void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      const ColorConverter& converter,
+                      unsigned firstRow, unsigned endRow);
 
 void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      const ColorConverter& converter,
+                      unsigned firstRow, unsigned endRow);
 
 } // namespace implementation
 } // namespace V1_0
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_BUFFERCOPYKERNELS_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_BUFFERCOPYKERNELS_H
+
+#include <stdint.h>
+
+#include "ColorConvert.h"
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+using ::android::automotive::evs::support::ColorCoefficients;
+using ::android::automotive::evs::support::ColorConverter;
+
+
+// Row level kernels used by the fill* functions in bufferCopy.cpp.  Each takes one row (or
+// pair of rows) of source pixels and writes the matching output; the caller owns all stride
+// and plane layout decisions.  Widths are in pixels and are expected to be even.
+struct BufferCopyKernels {
+    const char* name;
+
+    // Converts a row of packed YUYV into 32bit RGBx using the given color matrix
+    void (*rgbaFromYuyvRow)(const uint8_t* src, uint32_t* dst, unsigned width,
+                            const ColorConverter& converter);
+
+    // Splits two rows of packed YUYV into two rows of Y and one row of interleaved U/V
+    // values averaged between the two source rows
+    void (*nv21FromYuyvRows)(const uint8_t* srcTop, const uint8_t* srcBot,
+                             uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width);
+
+    // Swaps the bytes in each 16 bit word to turn a row of UYVY into YUYV
+    void (*yuyvFromUyvyRow)(const uint8_t* src, uint8_t* dst, unsigned width);
+};
+
+
+// The scalar reference kernels.  SIMD implementations must match these bit for bit and use
+// them to finish any pixels left over at the end of a row.  The color conversion itself is
+// defined by ColorCoefficients (see ColorConvert.h); the scalar kernel uses the converter's
+// lookup tables while the SIMD kernels multiply by its coefficients directly.
+void rgbaFromYuyvRowScalar(const uint8_t* src, uint32_t* dst, unsigned width,
+                           const ColorConverter& converter);
+void nv21FromYuyvRowsScalar(const uint8_t* srcTop, const uint8_t* srcBot,
+                            uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width);
+void yuyvFromUyvyRowScalar(const uint8_t* src, uint8_t* dst, unsigned width);
+
+
+#if defined(__i386__) || defined(__x86_64__)
+// From bufferCopy_sse.cpp
+extern const BufferCopyKernels kSse41Kernels;
+extern const BufferCopyKernels kAvx2Kernels;
+#endif
+
+#if defined(__arm__) || defined(__aarch64__)
+// From bufferCopy_neon.cpp
+extern const BufferCopyKernels kNeonKernels;
+#endif
+
+
+// Returns the fastest kernel set supported by the CPU we're running on.  The choice is made
+// once, on first use, and remains fixed for the life of the process.
+const BufferCopyKernels& getBufferCopyKernels();
+
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_BUFFERCOPYKERNELS_H
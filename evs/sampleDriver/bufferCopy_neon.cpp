@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bufferCopyKernels.h"
+
+#include <arm_neon.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Given 8 Y values and the U/V values they share, compute 8 pixels worth of R, G, and B
+static inline void yuvToRgb8Neon(uint8x8_t y, int16x8_t u, int16x8_t v,
+                                 const ColorCoefficients& coef,
+                                 uint8x8_t* r, uint8x8_t* g, uint8x8_t* b) {
+    const int16x8_t yBias = vdupq_n_s16(coef.yBias);
+
+    int16x8_t yTerm = vmlaq_n_s16(yBias, vreinterpretq_s16_u16(vmovl_u8(y)), coef.yMul);
+    int16x8_t rSum = vqaddq_s16(yTerm, vmulq_n_s16(v, coef.rv));
+    int16x8_t gSum = vqsubq_s16(vqsubq_s16(yTerm, vmulq_n_s16(u, coef.gu)),
+                                vmulq_n_s16(v, coef.gv));
+    int16x8_t bSum = vqaddq_s16(yTerm, vmulq_n_s16(u, coef.bu));
+
+    // Scale back down and saturate to 8 bits per channel
+    *r = vqshrun_n_s16(rSum, ColorCoefficients::kShift);
+    *g = vqshrun_n_s16(gSum, ColorCoefficients::kShift);
+    *b = vqshrun_n_s16(bSum, ColorCoefficients::kShift);
+}
+
+
+// 16 pixels per step
+static void rgbaFromYuyvRowNeon(const uint8_t* src, uint32_t* dst, unsigned width,
+                                const ColorConverter& converter) {
+    const ColorCoefficients& coef = converter.getCoefficients();
+    const int16x8_t bias = vdupq_n_s16(128);
+
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        // De-interleave 8 macro pixels into even Y, U, odd Y, and V
+        uint8x8x4_t yuyv = vld4_u8(src + c*2);
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[1])), bias);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[3])), bias);
+
+        uint8x8_t rEven, gEven, bEven;
+        uint8x8_t rOdd,  gOdd,  bOdd;
+        yuvToRgb8Neon(yuyv.val[0], u, v, coef, &rEven, &gEven, &bEven);
+        yuvToRgb8Neon(yuyv.val[2], u, v, coef, &rOdd,  &gOdd,  &bOdd);
+
+        // Put the even and odd pixels back in order and store them as R, G, B, A bytes
+        uint8x8x2_t r = vzip_u8(rEven, rOdd);
+        uint8x8x2_t g = vzip_u8(gEven, gOdd);
+        uint8x8x2_t b = vzip_u8(bEven, bOdd);
+        const uint8x8_t a = vdup_n_u8(0xFF);
+
+        uint8x8x4_t rgbaLo = {{ r.val[0], g.val[0], b.val[0], a }};
+        uint8x8x4_t rgbaHi = {{ r.val[1], g.val[1], b.val[1], a }};
+        vst4_u8((uint8_t*)(dst + c),     rgbaLo);
+        vst4_u8((uint8_t*)(dst + c + 8), rgbaHi);
+    }
+
+    rgbaFromYuyvRowScalar(src + c*2, dst + c, width - c, converter);
+}
+
+
+// 16 pixels per step
+static void nv21FromYuyvRowsNeon(const uint8_t* srcTop, const uint8_t* srcBot,
+                                 uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        // Split each row into its Y values and its interleaved U/V values
+        uint8x16x2_t top = vld2q_u8(srcTop + c*2);
+        uint8x16x2_t bot = vld2q_u8(srcBot + c*2);
+
+        vst1q_u8(yTop + c, top.val[0]);
+        vst1q_u8(yBot + c, bot.val[0]);
+
+        // Halving add averages the two rows, rounding down like the scalar code
+        vst1q_u8(uv + c, vhaddq_u8(top.val[1], bot.val[1]));
+    }
+
+    nv21FromYuyvRowsScalar(srcTop + c*2, srcBot + c*2,
+                           yTop + c, yBot + c, uv + c, width - c);
+}
+
+
+// 8 pixels per step
+static void yuyvFromUyvyRowNeon(const uint8_t* src, uint8_t* dst, unsigned width) {
+    unsigned c = 0;
+    for (; c + 8 <= width; c += 8) {
+        vst1q_u8(dst + c*2, vrev16q_u8(vld1q_u8(src + c*2)));
+    }
+
+    yuyvFromUyvyRowScalar(src + c*2, dst + c*2, width - c);
+}
+
+
+const BufferCopyKernels kNeonKernels = {
+    .name               = "NEON",
+    .rgbaFromYuyvRow    = rgbaFromYuyvRowNeon,
+    .nv21FromYuyvRows   = nv21FromYuyvRowsNeon,
+    .yuyvFromUyvyRow    = yuyvFromUyvyRowNeon,
+};
+
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bufferCopyKernels.h"
+
+#include <immintrin.h>
+
+// Each kernel is compiled for its own instruction set via a target attribute so that this
+// file can be built with the default x86 flags.  bufferCopy.cpp only selects a kernel set
+// after checking the CPU supports it.
+#define TARGET_SSE41    __attribute__((target("sse4.1")))
+#define TARGET_AVX2     __attribute__((target("avx2")))
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+//
+// SSE4.1 kernels -- 8 pixels per step
+//
+
+// The color matrix broadcast into registers, loaded once per row
+struct YuvCoefSse41 {
+    __m128i yMul;
+    __m128i yBias;
+    __m128i rv;
+    __m128i gu;
+    __m128i gv;
+    __m128i bu;
+};
+
+
+// Given 8 pixels of YUYV, return 8 RGBx pixels in two registers
+TARGET_SSE41
+static inline void yuyvToRgbx8Sse41(__m128i yuyv, const YuvCoefSse41& coef,
+                                    __m128i* rgbxLo, __m128i* rgbxHi) {
+    const __m128i lowBytes  = _mm_set1_epi16(0x00FF);
+    const __m128i bias      = _mm_set1_epi16(128);
+
+    // Spread the shared U and V values of each macro pixel across both of its pixels
+    const __m128i dupU = _mm_setr_epi8(1, -1, 1, -1, 5, -1, 5, -1, 9, -1, 9, -1, 13, -1, 13, -1);
+    const __m128i dupV = _mm_setr_epi8(3, -1, 3, -1, 7, -1, 7, -1, 11, -1, 11, -1, 15, -1, 15, -1);
+
+    __m128i y = _mm_and_si128(yuyv, lowBytes);
+    __m128i u = _mm_sub_epi16(_mm_shuffle_epi8(yuyv, dupU), bias);
+    __m128i v = _mm_sub_epi16(_mm_shuffle_epi8(yuyv, dupV), bias);
+
+    __m128i yTerm = _mm_add_epi16(_mm_mullo_epi16(y, coef.yMul), coef.yBias);
+    __m128i r = _mm_adds_epi16(yTerm, _mm_mullo_epi16(v, coef.rv));
+    __m128i g = _mm_subs_epi16(_mm_subs_epi16(yTerm, _mm_mullo_epi16(u, coef.gu)),
+                               _mm_mullo_epi16(v, coef.gv));
+    __m128i b = _mm_adds_epi16(yTerm, _mm_mullo_epi16(u, coef.bu));
+
+    // Scale back down and saturate to 8 bits per channel
+    const int shift = ColorCoefficients::kShift;
+    __m128i r8 = _mm_packus_epi16(_mm_srai_epi16(r, shift), _mm_setzero_si128());
+    __m128i g8 = _mm_packus_epi16(_mm_srai_epi16(g, shift), _mm_setzero_si128());
+    __m128i b8 = _mm_packus_epi16(_mm_srai_epi16(b, shift), _mm_setzero_si128());
+    __m128i a8 = _mm_set1_epi8(-1);
+
+    // Interleave into R, G, B, A byte order
+    __m128i rg = _mm_unpacklo_epi8(r8, g8);
+    __m128i ba = _mm_unpacklo_epi8(b8, a8);
+    *rgbxLo = _mm_unpacklo_epi16(rg, ba);
+    *rgbxHi = _mm_unpackhi_epi16(rg, ba);
+}
+
+
+TARGET_SSE41
+static void rgbaFromYuyvRowSse41(const uint8_t* src, uint32_t* dst, unsigned width,
+                                 const ColorConverter& converter) {
+    const ColorCoefficients& c16 = converter.getCoefficients();
+    const YuvCoefSse41 coef = {
+        _mm_set1_epi16(c16.yMul), _mm_set1_epi16(c16.yBias),
+        _mm_set1_epi16(c16.rv),   _mm_set1_epi16(c16.gu),
+        _mm_set1_epi16(c16.gv),   _mm_set1_epi16(c16.bu),
+    };
+
+    unsigned c = 0;
+    for (; c + 8 <= width; c += 8) {
+        __m128i yuyv = _mm_loadu_si128((const __m128i*)(src + c*2));
+        __m128i lo, hi;
+        yuyvToRgbx8Sse41(yuyv, coef, &lo, &hi);
+        _mm_storeu_si128((__m128i*)(dst + c), lo);
+        _mm_storeu_si128((__m128i*)(dst + c + 4), hi);
+    }
+
+    rgbaFromYuyvRowScalar(src + c*2, dst + c, width - c, converter);
+}
+
+
+TARGET_SSE41
+static void nv21FromYuyvRowsSse41(const uint8_t* srcTop, const uint8_t* srcBot,
+                                  uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        __m128i top0 = _mm_loadu_si128((const __m128i*)(srcTop + c*2));
+        __m128i top1 = _mm_loadu_si128((const __m128i*)(srcTop + c*2 + 16));
+        __m128i bot0 = _mm_loadu_si128((const __m128i*)(srcBot + c*2));
+        __m128i bot1 = _mm_loadu_si128((const __m128i*)(srcBot + c*2 + 16));
+
+        // Y values are the even bytes
+        _mm_storeu_si128((__m128i*)(yTop + c),
+                         _mm_packus_epi16(_mm_and_si128(top0, lowBytes),
+                                          _mm_and_si128(top1, lowBytes)));
+        _mm_storeu_si128((__m128i*)(yBot + c),
+                         _mm_packus_epi16(_mm_and_si128(bot0, lowBytes),
+                                          _mm_and_si128(bot1, lowBytes)));
+
+        // U/V values are the odd bytes, averaged (rounding down) between the two rows
+        __m128i uv0 = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(top0, 8),
+                                                   _mm_srli_epi16(bot0, 8)), 1);
+        __m128i uv1 = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(top1, 8),
+                                                   _mm_srli_epi16(bot1, 8)), 1);
+        _mm_storeu_si128((__m128i*)(uv + c), _mm_packus_epi16(uv0, uv1));
+    }
+
+    nv21FromYuyvRowsScalar(srcTop + c*2, srcBot + c*2,
+                           yTop + c, yBot + c, uv + c, width - c);
+}
+
+
+TARGET_SSE41
+static void yuyvFromUyvyRowSse41(const uint8_t* src, uint8_t* dst, unsigned width) {
+    const __m128i swapBytes = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                            9, 8, 11, 10, 13, 12, 15, 14);
+    unsigned c = 0;
+    for (; c + 8 <= width; c += 8) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(src + c*2));
+        _mm_storeu_si128((__m128i*)(dst + c*2), _mm_shuffle_epi8(pixels, swapBytes));
+    }
+
+    yuyvFromUyvyRowScalar(src + c*2, dst + c*2, width - c);
+}
+
+
+//
+// AVX2 kernels -- 16 pixels per step
+//
+// Most AVX2 integer operations work independently on each 128 bit half of the register, so
+// these mirror the SSE kernels and fix up the ordering of the halves before storing.
+//
+
+TARGET_AVX2
+static void rgbaFromYuyvRowAvx2(const uint8_t* src, uint32_t* dst, unsigned width,
+                                const ColorConverter& converter) {
+    const ColorCoefficients& c16 = converter.getCoefficients();
+    const __m256i lowBytes  = _mm256_set1_epi16(0x00FF);
+    const __m256i bias      = _mm256_set1_epi16(128);
+    const __m256i yMul      = _mm256_set1_epi16(c16.yMul);
+    const __m256i yBias     = _mm256_set1_epi16(c16.yBias);
+    const __m256i coefRV    = _mm256_set1_epi16(c16.rv);
+    const __m256i coefGU    = _mm256_set1_epi16(c16.gu);
+    const __m256i coefGV    = _mm256_set1_epi16(c16.gv);
+    const __m256i coefBU    = _mm256_set1_epi16(c16.bu);
+    const int shift = ColorCoefficients::kShift;
+    const __m256i dupU = _mm256_setr_epi8(1, -1, 1, -1, 5, -1, 5, -1, 9, -1, 9, -1, 13, -1, 13, -1,
+                                          1, -1, 1, -1, 5, -1, 5, -1, 9, -1, 9, -1, 13, -1, 13, -1);
+    const __m256i dupV = _mm256_setr_epi8(3, -1, 3, -1, 7, -1, 7, -1, 11, -1, 11, -1, 15, -1, 15, -1,
+                                          3, -1, 3, -1, 7, -1, 7, -1, 11, -1, 11, -1, 15, -1, 15, -1);
+    const __m256i a8 = _mm256_set1_epi8(-1);
+
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        __m256i yuyv = _mm256_loadu_si256((const __m256i*)(src + c*2));
+
+        __m256i y = _mm256_and_si256(yuyv, lowBytes);
+        __m256i u = _mm256_sub_epi16(_mm256_shuffle_epi8(yuyv, dupU), bias);
+        __m256i v = _mm256_sub_epi16(_mm256_shuffle_epi8(yuyv, dupV), bias);
+
+        __m256i yTerm = _mm256_add_epi16(_mm256_mullo_epi16(y, yMul), yBias);
+        __m256i r = _mm256_adds_epi16(yTerm, _mm256_mullo_epi16(v, coefRV));
+        __m256i g = _mm256_subs_epi16(_mm256_subs_epi16(yTerm, _mm256_mullo_epi16(u, coefGU)),
+                                      _mm256_mullo_epi16(v, coefGV));
+        __m256i b = _mm256_adds_epi16(yTerm, _mm256_mullo_epi16(u, coefBU));
+
+        __m256i r8 = _mm256_packus_epi16(_mm256_srai_epi16(r, shift), _mm256_setzero_si256());
+        __m256i g8 = _mm256_packus_epi16(_mm256_srai_epi16(g, shift), _mm256_setzero_si256());
+        __m256i b8 = _mm256_packus_epi16(_mm256_srai_epi16(b, shift), _mm256_setzero_si256());
+
+        __m256i rg = _mm256_unpacklo_epi8(r8, g8);
+        __m256i ba = _mm256_unpacklo_epi8(b8, a8);
+        __m256i lo = _mm256_unpacklo_epi16(rg, ba);     // pixels 0-3 and 8-11
+        __m256i hi = _mm256_unpackhi_epi16(rg, ba);     // pixels 4-7 and 12-15
+
+        _mm256_storeu_si256((__m256i*)(dst + c),     _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst + c + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    rgbaFromYuyvRowSse41(src + c*2, dst + c, width - c, converter);
+}
+
+
+TARGET_AVX2
+static void nv21FromYuyvRowsAvx2(const uint8_t* srcTop, const uint8_t* srcBot,
+                                 uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+
+    unsigned c = 0;
+    for (; c + 32 <= width; c += 32) {
+        __m256i top0 = _mm256_loadu_si256((const __m256i*)(srcTop + c*2));
+        __m256i top1 = _mm256_loadu_si256((const __m256i*)(srcTop + c*2 + 32));
+        __m256i bot0 = _mm256_loadu_si256((const __m256i*)(srcBot + c*2));
+        __m256i bot1 = _mm256_loadu_si256((const __m256i*)(srcBot + c*2 + 32));
+
+        // packus interleaves the 64 bit quarters of its inputs, so put them back in order
+        __m256i yT = _mm256_packus_epi16(_mm256_and_si256(top0, lowBytes),
+                                         _mm256_and_si256(top1, lowBytes));
+        __m256i yB = _mm256_packus_epi16(_mm256_and_si256(bot0, lowBytes),
+                                         _mm256_and_si256(bot1, lowBytes));
+        _mm256_storeu_si256((__m256i*)(yTop + c), _mm256_permute4x64_epi64(yT, 0xD8));
+        _mm256_storeu_si256((__m256i*)(yBot + c), _mm256_permute4x64_epi64(yB, 0xD8));
+
+        __m256i uv0 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_srli_epi16(top0, 8),
+                                                         _mm256_srli_epi16(bot0, 8)), 1);
+        __m256i uv1 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_srli_epi16(top1, 8),
+                                                         _mm256_srli_epi16(bot1, 8)), 1);
+        _mm256_storeu_si256((__m256i*)(uv + c),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(uv0, uv1), 0xD8));
+    }
+
+    nv21FromYuyvRowsSse41(srcTop + c*2, srcBot + c*2, yTop + c, yBot + c, uv + c, width - c);
+}
+
+
+TARGET_AVX2
+static void yuyvFromUyvyRowAvx2(const uint8_t* src, uint8_t* dst, unsigned width) {
+    const __m256i swapBytes = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                               9, 8, 11, 10, 13, 12, 15, 14,
+                                               1, 0, 3, 2, 5, 4, 7, 6,
+                                               9, 8, 11, 10, 13, 12, 15, 14);
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + c*2));
+        _mm256_storeu_si256((__m256i*)(dst + c*2), _mm256_shuffle_epi8(pixels, swapBytes));
+    }
+
+    yuyvFromUyvyRowSse41(src + c*2, dst + c*2, width - c);
+}
+
+
+const BufferCopyKernels kSse41Kernels = {
+    .name               = "SSE4.1",
+    .rgbaFromYuyvRow    = rgbaFromYuyvRowSse41,
+    .nv21FromYuyvRows   = nv21FromYuyvRowsSse41,
+    .yuyvFromUyvyRow    = yuyvFromUyvyRowSse41,
+};
+
+const BufferCopyKernels kAvx2Kernels = {
+    .name               = "AVX2",
+    .rgbaFromYuyvRow    = rgbaFromYuyvRowAvx2,
+    .nv21FromYuyvRows   = nv21FromYuyvRowsAvx2,
+    .yuyvFromUyvyRow    = yuyvFromUyvyRowAvx2,
+};
+
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <hidl/HidlTransportSupport.h>
@@ -24,6 +27,11 @@
 #include "ServiceNames.h"
 #include "EvsEnumerator.h"
 #include "EvsGlDisplay.h"
+#include "EvsV4lCamera.h"
+#include "VideoCapture.h"
+#include "bufferCopyKernels.h"
+#include "ConversionPool.h"
+#include "CaptureConfig.h"
 
 
 // libhidl:
@@ -39,8 +47,109 @@ using namespace android::hardware::automotive::evs::V1_0::implementation;
 using namespace android;
 
 
-int main() {
+// Parses a comma separated list of cpu numbers, such as "2,3"
+static std::vector<int> parseCpuList(const char* list) {
+    std::vector<int> cpus;
+    const char* next = list;
+    while (*next) {
+        char* end = nullptr;
+        long cpu = strtol(next, &end, 10);
+        if (end == next || cpu < 0) {
+            ALOGE("Ignoring malformed cpu list '%s'", list);
+            return std::vector<int>();
+        }
+        cpus.push_back(cpu);
+        next = (*end == ',') ? end + 1 : end;
+    }
+    return cpus;
+}
+
+
+int main(int argc, char** argv) {
     ALOGI("EVS Hardware Enumerator service is starting");
+
+    // Set up default behavior, then check for command line options
+    bool printHelp = false;
+    int convertThreads = -1;    // Let the conversion pool choose based on the number of cores
+    std::vector<int> convertCpus;
+    const char* configFileName = "/system/etc/automotive/evs/capture_config.json";
+    for (int i=1; i< argc; i++) {
+        if (strcmp(argv[i], "--convert-threads") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--convert-threads <count> was not provided with a thread count\n");
+            } else {
+                convertThreads = atoi(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--convert-cpus") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--convert-cpus <list> was not provided with a cpu list\n");
+            } else {
+                convertCpus = parseCpuList(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--capture-buffers") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--capture-buffers <count> was not provided with a buffer count\n");
+            } else {
+                VideoCapture::setDefaultBufferCount(atoi(argv[i]));
+            }
+        } else if (strcmp(argv[i], "--config") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--config <file> was not provided with a file name\n");
+            } else {
+                configFileName = argv[i];
+            }
+        } else if (strcmp(argv[i], "--stall-threshold") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--stall-threshold <ms> was not provided with a time\n");
+            } else {
+                VideoCapture::setStallThreshold(atoi(argv[i]));
+            }
+        } else if (strcmp(argv[i], "--shared-capture-thread") == 0) {
+            VideoCapture::setSharedCaptureThread(true);
+        } else if (strcmp(argv[i], "--no-zero-copy") == 0) {
+            EvsV4lCamera::setZeroCopyAllowed(false);
+        } else if (strcmp(argv[i], "--no-persistent-map") == 0) {
+            EvsV4lCamera::setPersistentMapping(false);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printHelp = true;
+        } else {
+            printf("Ignoring unrecognized command line arg '%s'\n", argv[i]);
+            printHelp = true;
+        }
+    }
+    if (printHelp) {
+        printf("Options include:\n");
+        printf("  --convert-threads <count>  Worker threads used to convert camera frames\n");
+        printf("  --convert-cpus <list>      Pin conversion threads to these cpus (ie: 2,3)\n");
+        printf("  --capture-buffers <count>  Buffers each camera captures into (default 4)\n");
+        printf("  --stall-threshold <ms>     Warn when a camera goes this long without a frame\n");
+        printf("  --shared-capture-thread    Collect frames from all cameras on one thread\n");
+        printf("  --no-zero-copy             Always copy camera frames into the output buffers\n");
+        printf("  --no-persistent-map        Lock and unlock the output buffers around every frame\n");
+        printf("  --config <file>            Read per camera capture settings from this file\n");
+    }
+
+    // Per camera capture settings must be in place before the enumerator opens any camera
+    if (!CaptureConfig::load(configFileName)) {
+        ALOGE("Ignoring malformed capture configuration");
+    }
+
+    // Pick our pixel conversion kernels and start the conversion threads now rather than on
+    // the first camera frame
+    getBufferCopyKernels();
+    if (convertThreads >= 0) {
+        ConversionPool::configure(convertThreads, convertCpus);
+    } else if (!convertCpus.empty()) {
+        // One thread for each cpu we were given
+        ConversionPool::configure(convertCpus.size(), convertCpus);
+    }
+    ConversionPool::get();
+
     android::sp<IEvsEnumerator> service = new EvsEnumerator();
 
     configureRpcThreadpool(1, true /* callerWillJoin */);
@@ -0,0 +1,25 @@
+LOCAL_PATH:= $(call my-dir)
+
+##################################
+# Code shared between the EVS sample driver, manager, and application
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    BufferSync.cpp \
+    ColorConvert.cpp \
+    FormatConvert.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    liblog \
+
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
+
+LOCAL_MODULE := libevssupport
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -DLOG_TAG=\"EvsSupport\"
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_STATIC_LIBRARY)
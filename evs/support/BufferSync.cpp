@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BufferSync.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
+
+#include <log/log.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+
+void syncCpuWrite(const native_handle_t* handle, uint64_t flags) {
+    if (handle == nullptr || handle->numFds < 1) {
+        return;
+    }
+
+    dma_buf_sync sync = {};
+    sync.flags = flags | DMA_BUF_SYNC_WRITE;
+    if (ioctl(handle->data[0], DMA_BUF_IOCTL_SYNC, &sync) < 0 && errno != ENOTTY) {
+        ALOGW("dma-buf sync failed (%s)", strerror(errno));
+    }
+}
+
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
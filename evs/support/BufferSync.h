@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_BUFFERSYNC_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_BUFFERSYNC_H
+
+#include <stdint.h>
+
+#include <cutils/native_handle.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+
+// Brackets CPU writes into a buffer kept mapped across frames, with DMA_BUF_SYNC_START before
+// and DMA_BUF_SYNC_END after.  Gralloc only does the cache maintenance for us at lock and unlock,
+// so without this the GPU can read stale lines on hardware that isn't cache coherent.  Buffers
+// which aren't dma-bufs don't need it, and are left alone.
+void syncCpuWrite(const native_handle_t* handle, uint64_t flags);
+
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif // ANDROID_AUTOMOTIVE_EVS_SUPPORT_BUFFERSYNC_H
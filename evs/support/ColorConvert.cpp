@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ColorConvert.h"
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+
+// Round a real valued coefficient to our fixed point representation
+static int16_t toFixed(float value) {
+    const float scaled = value * (1 << ColorCoefficients::kShift);
+    return (int16_t)((scaled < 0) ? (scaled - 0.5f) : (scaled + 0.5f));
+}
+
+
+static ColorCoefficients computeCoefficients(ColorMatrix matrix, ColorRange range) {
+    // Luma weights of red and blue for each standard (green makes up the rest)
+    float Kr, Kb;
+    switch (matrix) {
+    case COLOR_MATRIX_BT709:    Kr = 0.2126f;   Kb = 0.0722f;   break;
+    case COLOR_MATRIX_BT601:
+    default:                    Kr = 0.299f;    Kb = 0.114f;    break;
+    }
+    const float Kg = 1.0f - Kr - Kb;
+
+    // Limited range data needs to be stretched back out to 0-255
+    const bool limited = (range != COLOR_RANGE_FULL);
+    const float yScale = limited ? (255.0f / 219.0f) : 1.0f;
+    const float cScale = limited ? (255.0f / 224.0f) : 1.0f;
+
+    ColorCoefficients coef;
+    coef.yMul  = toFixed(yScale);
+    coef.yBias = (limited ? -16 * coef.yMul : 0) + (1 << (ColorCoefficients::kShift - 1));
+    coef.rv    = toFixed(cScale * 2.0f * (1.0f - Kr));
+    coef.gu    = toFixed(cScale * 2.0f * Kb * (1.0f - Kb) / Kg);
+    coef.gv    = toFixed(cScale * 2.0f * Kr * (1.0f - Kr) / Kg);
+    coef.bu    = toFixed(cScale * 2.0f * (1.0f - Kb));
+    return coef;
+}
+
+
+ColorConverter::ColorConverter(ColorMatrix matrix, ColorRange range) {
+    configure(matrix, range);
+}
+
+
+void ColorConverter::configure(ColorMatrix matrix, ColorRange range) {
+    mMatrix = matrix;
+    mRange = range;
+    mCoefficients = computeCoefficients(matrix, range);
+
+    for (int i = 0; i < 256; i++) {
+        const int c = i - 128;
+        mYTable[i]  = i * mCoefficients.yMul + mCoefficients.yBias;
+        mRVTable[i] = c * mCoefficients.rv;
+        mGUTable[i] = c * mCoefficients.gu;
+        mGVTable[i] = c * mCoefficients.gv;
+        mBUTable[i] = c * mCoefficients.bu;
+    }
+
+    for (int i = 0; i < kClampOffset * 2; i++) {
+        const int v = i - kClampOffset;
+        mClampTable[i] = (v < 0) ? 0 : ((v > 255) ? 255 : v);
+    }
+}
+
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_COLORCONVERT_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_COLORCONVERT_H
+
+#include <stdint.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+
+// Which set of luma/chroma weights the YUV data was encoded with
+enum ColorMatrix : int32_t {
+    COLOR_MATRIX_BT601 = 0,     // Standard definition video
+    COLOR_MATRIX_BT709 = 1,     // HD video
+};
+
+// Whether the YUV data uses the full 0-255 range, or the 16-235 (luma) and
+// 16-240 (chroma) "studio swing" range
+enum ColorRange : int32_t {
+    COLOR_RANGE_LIMITED = 0,
+    COLOR_RANGE_FULL    = 1,
+};
+
+
+// Integer form of a YUV to RGB matrix.  Every conversion in the EVS stack, scalar or SIMD,
+// evaluates
+//      Yterm = Y*yMul + yBias
+//      R = (Yterm + RV*(V-128)) >> kShift
+//      G = (Yterm - GU*(U-128) - GV*(V-128)) >> kShift
+//      B = (Yterm + BU*(U-128)) >> kShift
+// and clamps the results to [0, 255].  yBias folds in both the black level and rounding.
+// The coefficients are small enough that every intermediate fits in a signed 16 bit lane, with
+// the exception of B near white, where SIMD saturation and the scalar clamp both produce 255.
+struct ColorCoefficients {
+    static const int kShift = 6;
+
+    int16_t yMul;
+    int16_t yBias;
+    int16_t rv;
+    int16_t gu;
+    int16_t gv;
+    int16_t bu;
+};
+
+
+// Precomputes per channel lookup tables for a chosen matrix and range so that converting a
+// pixel costs a handful of table reads and adds, with no multiplies, floats, or branches.
+class ColorConverter {
+public:
+    explicit ColorConverter(ColorMatrix matrix = COLOR_MATRIX_BT601,
+                            ColorRange range = COLOR_RANGE_LIMITED);
+
+    // Rebuild the tables for a different matrix or range
+    void configure(ColorMatrix matrix, ColorRange range);
+
+    ColorMatrix getMatrix() const                       { return mMatrix; };
+    ColorRange getRange() const                         { return mRange; };
+    const ColorCoefficients& getCoefficients() const    { return mCoefficients; };
+
+    // Returns a 32bit RGBx value with R in the low byte and the alpha channel set to ones
+    inline uint32_t yuvToRgbx(uint8_t Y, uint8_t U, uint8_t V) const {
+        const int Yterm = mYTable[Y];
+        const uint32_t R = mClampTable[((Yterm + mRVTable[V]) >> ColorCoefficients::kShift)
+                                       + kClampOffset];
+        const uint32_t G = mClampTable[((Yterm - mGUTable[U] - mGVTable[V])
+                                        >> ColorCoefficients::kShift) + kClampOffset];
+        const uint32_t B = mClampTable[((Yterm + mBUTable[U]) >> ColorCoefficients::kShift)
+                                       + kClampOffset];
+
+        return R | (G << 8) | (B << 16) | 0xFF000000;
+    }
+
+    // Returns the matrix conventionally used for video of the given height when the source
+    // doesn't tell us otherwise
+    static ColorMatrix defaultMatrixForHeight(unsigned height) {
+        return (height >= 720) ? COLOR_MATRIX_BT709 : COLOR_MATRIX_BT601;
+    }
+
+private:
+    // The sums above, after shifting, always land in [-kClampOffset, kClampOffset)
+    static const int kClampOffset = 1024;
+
+    ColorMatrix         mMatrix;
+    ColorRange          mRange;
+    ColorCoefficients   mCoefficients;
+
+    int32_t             mYTable[256];
+    int32_t             mRVTable[256];
+    int32_t             mGUTable[256];
+    int32_t             mGVTable[256];
+    int32_t             mBUTable[256];
+    uint8_t             mClampTable[kClampOffset * 2];
+};
+
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_COLORCONVERT_H
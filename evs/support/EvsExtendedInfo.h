@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_EVSEXTENDEDINFO_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_EVSEXTENDEDINFO_H
+
+#include <stdint.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+
+// Opaque identifiers understood by the getExtendedInfo/setExtendedInfo calls of the cameras
+// in this stack.  The values are arbitrary, but are chosen to be unlikely to collide with
+// identifiers used by other vendors' drivers.
+enum ExtendedInfoId : uint32_t {
+    // Value is a ColorMatrix (see ColorConvert.h)
+    EXTENDED_INFO_COLOR_MATRIX      = 0x45565301,
+
+    // Value is a ColorRange (see ColorConvert.h)
+    EXTENDED_INFO_COLOR_RANGE       = 0x45565302,
+
+    // Read only.  Frames currently waiting in, and the most ever waiting in, the queues between
+    // the capture, conversion, and delivery stages of the current stream.
+    EXTENDED_INFO_CONVERT_QUEUED    = 0x45565303,
+    EXTENDED_INFO_CONVERT_PEAK      = 0x45565304,
+    EXTENDED_INFO_DELIVER_QUEUED    = 0x45565305,
+    EXTENDED_INFO_DELIVER_PEAK      = 0x45565306,
+
+    // Read only.  Frames captured but never delivered during the current stream.
+    EXTENDED_INFO_FRAMES_DROPPED    = 0x45565307,
+
+    // Read only.  Average microseconds spent converting each frame of the current stream into
+    // its output buffer, including any buffer mapping and cache maintenance.
+    EXTENDED_INFO_CONVERT_TIME_US   = 0x45565308,
+
+    // Read only, answered by the manager.  Frames this client missed during the current stream
+    // because it still had too many waiting to be sent to it.
+    EXTENDED_INFO_CLIENT_FRAMES_OVERFLOWED = 0x45565309,
+
+    // Answered by the manager.  Frames per second this client wants to receive, with the frames
+    // in between declined before they are sent.  Zero (the default) passes every frame.
+    EXTENDED_INFO_CLIENT_FRAME_RATE = 0x4556530A,
+
+    // Answered by the manager.  Value is a DeliveryPolicy (below).
+    EXTENDED_INFO_CLIENT_DELIVERY_POLICY = 0x4556530B,
+
+    // Answered by the manager.  Cameras opened by one client which are given the same non zero
+    // group ID have their frames passed on in sets that arrived within the group's tolerance of
+    // each other.  Zero (the default) takes the camera out of its group.
+    EXTENDED_INFO_CLIENT_SYNC_GROUP = 0x4556530C,
+
+    // Answered by the manager.  Microseconds by which the frames of a set may differ in arrival
+    // time.  Applies to the whole of this camera's group; setting it before joining fails.
+    EXTENDED_INFO_CLIENT_SYNC_TOLERANCE_US = 0x4556530D,
+
+    // Read only, answered by the manager.  Sets delivered by this camera's group.
+    EXTENDED_INFO_CLIENT_SYNC_SETS = 0x4556530E,
+
+    // Answered by the manager.  The pixel format (HAL_PIXEL_FORMAT_*) this client wants its
+    // frames in.  Each frame is converted once for all the clients wanting the same format.
+    // Zero (the default) is the camera's own format, as is any format the camera's frames can't
+    // be converted into, so clients should still check BufferDesc::format.  Only
+    // HAL_PIXEL_FORMAT_RGBA_8888 is offered, and only while the stream is stopped.
+    EXTENDED_INFO_CLIENT_FORMAT     = 0x4556530F,
+
+    // Read only, answered by the manager.  Times the hardware stream behind this camera has been
+    // restarted, after stalling or the camera's death, since the camera was first opened.
+    EXTENDED_INFO_STREAM_RESTARTS   = 0x45565310,
+};
+
+
+// What the manager does with a new frame while a client holds all the frames it is allowed
+enum DeliveryPolicy : int32_t {
+    // The new frame is skipped, so the client sees every frame up to the point it fell behind.
+    // This is the default.
+    DELIVERY_POLICY_DROP_NEWEST     = 0,
+
+    // The newest frame is held back and sent as soon as the client returns one, so a client
+    // which catches up sees the latest image rather than a stale one.  Suits displays.
+    DELIVERY_POLICY_LATEST_WINS     = 1,
+};
+
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_EVSEXTENDEDINFO_H
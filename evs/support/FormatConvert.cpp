@@ -16,6 +16,14 @@
 
 #include "FormatConvert.h"
 
+#include <string.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
 
 // Round up to the nearest multiple of the given alignment value
 template<unsigned alignment>
@@ -28,38 +36,10 @@ int align(int value) {
 }
 
 
-// Limit the given value to the provided range.  :)
-static inline float clamp(float v, float min, float max) {
-    if (v < min) return min;
-    if (v > max) return max;
-    return v;
-}
-
-
-static uint32_t yuvToRgbx(const unsigned char Y, const unsigned char Uin, const unsigned char Vin) {
-    // Don't use this if you want to see the best performance.  :)
-    // Better to do this in a pixel shader if we really have to, but on actual
-    // embedded hardware we expect to be able to texture directly from the YUV data
-    float U = Uin - 128.0f;
-    float V = Vin - 128.0f;
-
-    float Rf = Y + 1.140f*V;
-    float Gf = Y - 0.395f*U - 0.581f*V;
-    float Bf = Y + 2.032f*U;
-    unsigned char R = (unsigned char)clamp(Rf, 0.0f, 255.0f);
-    unsigned char G = (unsigned char)clamp(Gf, 0.0f, 255.0f);
-    unsigned char B = (unsigned char)clamp(Bf, 0.0f, 255.0f);
-
-    return (R      ) |
-           (G <<  8) |
-           (B << 16) |
-           0xFF000000;  // Fill the alpha channel with ones
-}
-
-
 void copyNV21toRGB32(unsigned width, unsigned height,
                      uint8_t* src,
-                     uint32_t* dst, unsigned dstStridePixels)
+                     uint32_t* dst, unsigned dstStridePixels,
+                     const ColorConverter& converter)
 {
     // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleaved
     // U/V array.  It assumes an even width and height for the overall image, and a horizontal
@@ -82,7 +62,7 @@ void copyNV21toRGB32(unsigned width, unsigned height,
         for (unsigned c = 0; c < width; c++) {
             unsigned uCol = (c & ~1);   // uCol is always even and repeats 1:2 with Y values
             unsigned vCol = uCol | 1;   // vCol is always odd
-            rowDest[c] = yuvToRgbx(rowY[c], rowUV[uCol], rowUV[vCol]);
+            rowDest[c] = converter.yuvToRgbx(rowY[c], rowUV[uCol], rowUV[vCol]);
         }
     }
 }
@@ -90,7 +70,8 @@ void copyNV21toRGB32(unsigned width, unsigned height,
 
 void copyYV12toRGB32(unsigned width, unsigned height,
                      uint8_t* src,
-                     uint32_t* dst, unsigned dstStridePixels)
+                     uint32_t* dst, unsigned dstStridePixels,
+                     const ColorConverter& converter)
 {
     // The YV12 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 U array, followed
     // by another 1/2 x 1/2 V array.  It assumes an even width and height for the overall image,
@@ -116,7 +97,7 @@ void copyYV12toRGB32(unsigned width, unsigned height,
         uint32_t* rowDest = dst + r*dstStridePixels;
 
         for (unsigned c = 0; c < width; c++) {
-            rowDest[c] = yuvToRgbx(rowY[c], rowU[c], rowV[c]);
+            rowDest[c] = converter.yuvToRgbx(rowY[c], rowU[c], rowV[c]);
         }
     }
 }
@@ -124,7 +105,8 @@ void copyYV12toRGB32(unsigned width, unsigned height,
 
 void copyYUYVtoRGB32(unsigned width, unsigned height,
                      uint8_t* src, unsigned srcStridePixels,
-                     uint32_t* dst, unsigned dstStridePixels)
+                     uint32_t* dst, unsigned dstStridePixels,
+                     const ColorConverter& converter)
 {
     uint32_t* srcWords = (uint32_t*)src;
 
@@ -142,8 +124,8 @@ void copyYUYVtoRGB32(unsigned width, unsigned height,
             uint8_t V  = (srcPixel >> 24) & 0xFF;
 
             // On the RGB output, we're writing one pixel at a time
-            *(dst+0) = yuvToRgbx(Y1, U, V);
-            *(dst+1) = yuvToRgbx(Y2, U, V);
+            *(dst+0) = converter.yuvToRgbx(Y1, U, V);
+            *(dst+1) = converter.yuvToRgbx(Y2, U, V);
             dst += 2;
         }
 
@@ -167,3 +149,9 @@ void copyMatchedInterleavedFormats(unsigned width, unsigned height,
         dst = (uint8_t*)dst + dstStridePixels * pixelSize;
     }
 }
+
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -14,12 +14,22 @@
  * limitations under the License.
  */
 
-#ifndef EVS_VTS_FORMATCONVERT_H
-#define EVS_VTS_FORMATCONVERT_H
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_FORMATCONVERT_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_FORMATCONVERT_H
 
-#include <queue>
 #include <stdint.h>
 
+#include "ColorConvert.h"
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+
+// The YUV to RGB conversions below use the matrix and range configured in the given converter.
+
 
 // Given an image buffer in NV21 format (HAL_PIXEL_FORMAT_YCRCB_420_SP), output 32bit RGBx values.
 // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleaved
@@ -27,7 +37,8 @@
 // stride that is an even multiple of 16 bytes for both the Y and UV arrays.
 void copyNV21toRGB32(unsigned width, unsigned height,
                      uint8_t* src,
-                     uint32_t* dst, unsigned dstStridePixels);
+                     uint32_t* dst, unsigned dstStridePixels,
+                     const ColorConverter& converter);
 
 
 // Given an image buffer in YV12 format (HAL_PIXEL_FORMAT_YV12), output 32bit RGBx values.
@@ -37,7 +48,8 @@ void copyNV21toRGB32(unsigned width, unsigned height,
 // and V arrays.
 void copyYV12toRGB32(unsigned width, unsigned height,
                      uint8_t* src,
-                     uint32_t* dst, unsigned dstStridePixels);
+                     uint32_t* dst, unsigned dstStridePixels,
+                     const ColorConverter& converter);
 
 
 // Given an image buffer in YUYV format (HAL_PIXEL_FORMAT_YCBCR_422_I), output 32bit RGBx values.
@@ -45,8 +57,9 @@ void copyYV12toRGB32(unsigned width, unsigned height,
 // U/V array.  It assumes an even width and height for the overall image, and a horizontal
 // stride that is an even multiple of 16 bytes for both the Y and UV arrays.
 void copyYUYVtoRGB32(unsigned width, unsigned height,
-                     uint8_t* src, unsigned srcStrideBytes,
-                     uint32_t* dst, unsigned dstStrideBytes);
+                     uint8_t* src, unsigned srcStridePixels,
+                     uint32_t* dst, unsigned dstStridePixels,
+                     const ColorConverter& converter);
 
 
 // Given an simple rectangular image buffer with an integer number of bytes per pixel,
@@ -57,4 +70,10 @@ void copyMatchedInterleavedFormats(unsigned width, unsigned height,
                                    void* dst, unsigned dstStridePixels,
                                    unsigned pixelSize);
 
-#endif // EVS_VTS_FORMATCONVERT_H
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_FORMATCONVERT_H
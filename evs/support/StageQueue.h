@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_STAGEQUEUE_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_STAGEQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+
+// A bounded queue handing work from one thread to the next.  Producers which must never
+// wait use tryPush() and deal with a full queue themselves; the others block in push().  Once
+// closed, pushes fail and pop() returns whatever is left before reporting the queue empty.
+template <typename T>
+class StageQueue {
+public:
+    explicit StageQueue(unsigned capacity) : mCapacity(capacity) {};
+
+    // Returns false, leaving item untouched, if the queue is full or closed
+    bool tryPush(const T& item) {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mClosed || mItems.size() >= mCapacity) {
+            if (!mClosed) {
+                mDropped++;
+            }
+            return false;
+        }
+        push_Locked(item);
+        return true;
+    }
+
+    // Waits for room in the queue.  Returns false if the queue is closed.
+    bool push(const T& item) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mSpaceAvailable.wait(lock, [this]() { return mClosed || mItems.size() < mCapacity; });
+        if (mClosed) {
+            return false;
+        }
+        push_Locked(item);
+        return true;
+    }
+
+    // Waits for an item.  Returns false once the queue is closed and empty.
+    bool pop(T* item) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mItemAvailable.wait(lock, [this]() { return mClosed || !mItems.empty(); });
+        if (mItems.empty()) {
+            return false;
+        }
+        *item = mItems.front();
+        mItems.pop_front();
+        mSpaceAvailable.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mClosed = true;
+        mItemAvailable.notify_all();
+        mSpaceAvailable.notify_all();
+    }
+
+    // Reopens a closed queue for a new stream, clearing its statistics
+    void reopen() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mItems.clear();
+        mClosed = false;
+        mHighWater = 0;
+        mDropped = 0;
+    }
+
+    // Occupancy statistics
+    unsigned size()         { std::lock_guard<std::mutex> lock(mLock); return mItems.size(); };
+    unsigned highWater()    { std::lock_guard<std::mutex> lock(mLock); return mHighWater; };
+    unsigned dropped()      { std::lock_guard<std::mutex> lock(mLock); return mDropped; };
+
+private:
+    void push_Locked(const T& item) {
+        mItems.push_back(item);
+        if (mItems.size() > mHighWater) {
+            mHighWater = mItems.size();
+        }
+        mItemAvailable.notify_one();
+    }
+
+    const unsigned          mCapacity;
+    std::mutex              mLock;
+    std::condition_variable mItemAvailable;
+    std::condition_variable mSpaceAvailable;
+    std::deque<T>           mItems;
+    bool                    mClosed = true;     // Until the first stream starts
+    unsigned                mHighWater = 0;     // Most items ever waiting at once
+    unsigned                mDropped = 0;       // Items turned away because the queue was full
+};
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_STAGEQUEUE_H